@@ -3,22 +3,33 @@
 
 #include "al/app/al_App.hpp"
 #include "al/app/al_GUIDomain.hpp"
-#include "al/math/al_Random.hpp"
 
 using namespace al;
 
 #include <fstream>
+#include <random>
 #include <vector>
 using namespace std;
 
-Vec3f randomVec3f(float scale) {
-  return Vec3f(rnd::uniformS(), rnd::uniformS(), rnd::uniformS()) * scale;
+#include "../common/ParticleStepper.hpp"
+#include "../common/Philox.hpp"
+
+// keys every random draw; fix it to repeat a run
+uint64_t seed = random_device()();
+
+// A point in the cube of half-width `scale`: particle i's `draw`th at
+// `step`. It depends only on those and the seed, not on call order.
+Vec3f randomVec3f(uint32_t i, uint64_t step, uint32_t draw, float scale) {
+  auto v = Philox(seed).uniformS3(i, step, draw);
+  return Vec3f(v[0], v[1], v[2]) * scale;
 }
 string slurp(string fileName);  // forward declaration
 
 struct AlloApp : App {
   Parameter pointSize{"/pointSize", "", 1.0, 0.0, 2.0};
   Parameter timeStep{"/timeStep", "", 0.1, 0.01, 0.6};
+  ParameterMenu integrator{"/integrator"};
+  ParameterBool adaptive{"/adaptive", "", 0};  // substeps where it is stiff
   //
 
   ShaderProgram pointShader;
@@ -26,8 +37,10 @@ struct AlloApp : App {
   //  simulation state
   Mesh mesh;  // position *is inside the mesh* mesh.vertices() are the positions
   vector<Vec3f> velocity;
-  vector<Vec3f> acceleration;
+  vector<Vec3f> acceleration;  // kicks, applied at the next step
   vector<float> mass;
+  float minMass = 0;
+  ParticleStepper<Vec3f> stepper;
 
   void onInit() override {
     // set up GUI
@@ -36,6 +49,9 @@ struct AlloApp : App {
     gui.add(pointSize);  // add parameter to GUI
     gui.add(timeStep);   // add parameter to GUI
     //
+    integrator.setElements({"semi-implicit euler", "velocity verlet"});
+    gui.add(integrator);
+    gui.add(adaptive);
   }
 
   void onCreate() override {
@@ -48,17 +64,19 @@ struct AlloApp : App {
     //
 
     // c++11 "lambda" function
-    auto randomColor = []() { return HSV(rnd::uniform(), 1.0f, 1.0f); };
+    auto randomColor = [](int i) {
+      return HSV(Philox(seed, 1).uniform(i, 0), 1.0f, 1.0f);
+    };
 
     mesh.primitive(Mesh::POINTS);
     // does 1000 work on your system? how many can you make before you get a low
     // frame rate? do you need to use <1000?
-    for (int _ = 0; _ < 1000; _++) {
-      mesh.vertex(randomVec3f(5));
-      mesh.color(randomColor());
+    for (int i = 0; i < 1000; i++) {
+      mesh.vertex(randomVec3f(i, 0, 0, 5));
+      mesh.color(randomColor(i));
 
       // float m = rnd::uniform(3.0, 0.5);
-      float m = 3 + rnd::normal() / 2;
+      float m = 3 + Philox(seed, 2).normal(i, 0) / 2;
       if (m < 0.5) m = 0.5;
       mass.push_back(m);
 
@@ -66,9 +84,10 @@ struct AlloApp : App {
       mesh.texCoord(pow(m, 1.0f / 3), 0);  // s, t
 
       // separate state arrays
-      velocity.push_back(randomVec3f(0.1));
-      acceleration.push_back(randomVec3f(1));
+      velocity.push_back(randomVec3f(i, 0, 1, 0.1));
+      acceleration.push_back(randomVec3f(i, 0, 2, 1));
     }
+    minMass = *min_element(mass.begin(), mass.end());
 
     nav().pos(0, 0, 10);
   }
@@ -98,28 +117,26 @@ struct AlloApp : App {
     // of the Vec3f • .magSqr() ~ squared length of the Vec3f • .dot(Vec3f f) •
     // .cross(Vec3f f)
 
-    // drag
+    // kicks are impulses: a step of a / m, as the Euler step gave them
     for (int i = 0; i < velocity.size(); i++) {
-      acceleration[i] -= velocity[i] * 0.1;
-    }
-
-    // Integration
-    //
-    vector<Vec3f> &position(mesh.vertices());
-    for (int i = 0; i < velocity.size(); i++) {
-      // "semi-implicit" Euler integration
       velocity[i] += acceleration[i] / mass[i] * dt;
-      position[i] += velocity[i] * dt;
-
-      // Explicit (or "forward") Euler integration would look like this:
-      // position[i] += velocity[i] * dt;
-      // velocity[i] += acceleration[i] / mass[i] * dt;
+      acceleration[i].set(0);
     }
 
-    // clear all accelerations (IMPORTANT!!)
-    for (auto &a : acceleration) a.set(0);
+    stepper.integrator =
+        integrator == VELOCITY_VERLET ? VELOCITY_VERLET : SEMI_IMPLICIT_EULER;
+    stepper.adaptive = adaptive;
+    stepper.maxRate = 0.1 / minMass;  // the drag's
+    stepper.advance(mesh.vertices(), velocity, dt,
+                    [&](auto &x, auto &v, auto &a) {
+                      // drag, divided by the mass as it always was
+                      for (int i = 0; i < v.size(); i++) {
+                        a[i] = -v[i] * 0.1 / mass[i];
+                      }
+                    });
   }
 
+  int kicks = 0; // '1' presses so far, the step of their random draws
   bool onKeyDown(const Keyboard &k) override {
     if (k.key() == ' ') {
       freeze = !freeze;
@@ -127,10 +144,12 @@ struct AlloApp : App {
 
     if (k.key() == '1') {
       // introduce some "random" forces
+      kicks++;
       for (int i = 0; i < velocity.size(); i++) {
         // F = ma
-        acceleration[i] = randomVec3f(1) / mass[i];
+        acceleration[i] = randomVec3f(i, kicks, 0, 1) / mass[i];
       }
+      stepper.invalidate();  // the kick changes the drag
     }
 
     return true;
@@ -3,7 +3,6 @@
 
 #include "al/app/al_App.hpp"
 #include "al/app/al_GUIDomain.hpp"
-#include "al/math/al_Random.hpp"
 #include "al/graphics/al_Image.hpp"
 #include "al/io/al_File.hpp"
 
@@ -11,9 +10,12 @@ using namespace al;
 using namespace std;
 
 #include <fstream>
+#include <random>
 #include <vector>
 using namespace std;
 
+#include "../common/Philox.hpp"
+
 string slurp(string fileName); // forward declaration
 
 struct AlloApp : App
@@ -61,6 +63,8 @@ struct AlloApp : App
       exit(1);
     }
     auto aspect_ratio = 1.0f * image.width() / image.height();
+    // normals for the noise layout, one counter per pixel
+    Philox noise(random_device()());
 
     // can you believe this works with only one set of curly brackets?
     for (int j = 0; j < image.height(); j++)
@@ -87,7 +91,10 @@ struct AlloApp : App
         hsv.texCoord(0.05, 0);
 
         noice.color(pixel.r / 255.0, pixel.g / 255.0, pixel.b / 255.0);
-        noice.vertex(rnd::normal() * hsvCol.h, rnd::normal() * hsvCol.h, rnd::normal() * hsvCol.h);
+        int pixelIndex = j * image.width() + i;
+        auto n = noise.normal2(pixelIndex, 0, 0);
+        float n3 = noise.normal(pixelIndex, 0, 1);
+        noice.vertex(n[0] * hsvCol.h, n[1] * hsvCol.h, n3 * hsvCol.h);
         noice.texCoord(0.05, 0);
       }
 
@@ -0,0 +1,740 @@
+#pragma once
+
+// The Assignment3 charge force, without allolib, summed exactly, with a
+// Barnes-Hut octree, or only over near neighbours.
+//
+// Every pair of particles pushes apart along the line between them with
+// strength 1 / (r^2 + softening). Pairs whose hues are close around the
+// colour wheel pull together instead: |sin(pi * dh)| <= .08, so within
+// hueReach of each other. Both signs flip closer than flipDistance.
+//
+// EXACT sums every pair, O(N^2), a tile of particles against a tile at a
+// time with a branch-free kernel the compiler vectorizes (AVX-512 or AVX2
+// with -march=native, SSE otherwise). Each pair is done once and both
+// forces written, so two threads must never hold tiles in common: the
+// tile pairs go in rounds (a round-robin tournament, every tile in at
+// most one pair per round), a round's pairs run in parallel and the
+// rounds one after another. Every particle then adds up its force in the
+// same order whatever the number of threads, so the result is identical.
+//
+// BARNES_HUT (Barnes and Hut, Nature 1986) replaces a far-away octree
+// node with the centre of its particles, about O(N log N). The sign
+// depends on both hues, so one centre per node is not enough. Each node
+// keeps the count and position sum of its particles per hue bin, as
+// prefix sums over the bins. Then the particles in any arc of hues have
+// one centre in O(1). A node's force on particle i is
+//
+//   all of them repelling, at the centre of the node
+//   + twice the ones in i's arc attracting, at the centre of the arc.
+//
+// The arc's end bins are only partly inside it; they count by the part of
+// the bin that is, as if their hues were spread evenly. Leaves and nodes
+// within flipDistance of i are always summed pair by pair, so the flip and
+// the particle itself are exact.
+//
+// NEIGHBORS drops every pair farther apart than `cutoff`. That is a
+// different law rather than an approximation: far particles push each
+// one by 1 / r^2, and their pushes add up instead of cancelling, so most
+// of a particle's force is lost (bench/neighbors.cpp). What is left is
+// the local structure, the flip and the hue clumping. Every call sorts
+// the particles into a grid of cells at least cutoff wide and sums each
+// one's pairs from the cells around it, O(N neighbours). Every particle
+// writes only its own force, so the threads need no rounds. Verlet lists
+// kept across calls would not pay: in the app a particle moves most of a
+// cutoff per force evaluation, so they would be rebuilt every time.
+//
+// bench/barnes_hut.cpp reports Barnes-Hut's error against EXACT,
+// bench/neighbors.cpp the cutoff's and how far particles move per
+// evaluation, and bench/exact_kernel.cpp checks EXACT against the loop
+// particle.cpp used to have.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "../common/AlignedAllocator.hpp"
+#include "../common/FastMath.hpp"
+#include "../common/ThreadPool.hpp"
+
+enum ForceMode
+{
+  EXACT,
+  BARNES_HUT,
+  NEIGHBORS
+};
+
+class HueCharges
+{
+public:
+  static constexpr float softening = .001f;
+  static constexpr float flipDistance = .07f;
+  // asin(.08) / pi: the widest hue difference that still attracts
+  static constexpr float hueReach = .02549203f;
+  // 1 / 64 of the wheel is under a third of the arc, so at most the two
+  // end bins are split
+  static constexpr int hueBins = 64;
+  static constexpr int leafSize = 16;
+  static constexpr int maxDepth = 24;
+  // Particles per tile: a tile's positions, hues and forces, 3.5 KB, stay
+  // in L1 while another tile runs against them. Small enough that a round
+  // has a few tile pairs per thread at 10000 particles.
+  static constexpr int tile = 128;
+  // partial sums kept apart in pairKernel(): one AVX-512 register, two
+  // AVX2 ones
+  static constexpr int lanes = 16;
+  // the neighbour grid's cells per axis, at most; past that the cells
+  // grow instead
+  static constexpr int maxCells = 64;
+  // particles per parallelFor range in NEIGHBORS
+  static constexpr int neighborGrain = 256;
+
+  // inputs: positions and hues in [0, 1), set before compute()
+  aligned_vector<float> x, y, z, hue;
+
+  ForceMode mode = EXACT;
+  // a node is used whole once its width is below theta times its distance
+  float theta = 0.5f;
+  // NEIGHBORS: pairs farther apart than cutoff are left out
+  float cutoff = 0.5f;
+
+  // the force on each particle, before the app's eps0 * Ke
+  aligned_vector<float> fx, fy, fz;
+
+  int size() const { return (int)x.size(); }
+
+  void resize(int n)
+  {
+    for (auto *a : {&x, &y, &z, &hue, &fx, &fy, &fz})
+    {
+      a->resize(n);
+    }
+  }
+
+  // true if particles with these hues attract (before the flip)
+  static bool hueAttracts(float h1, float h2)
+  {
+    float d = std::fabs(h2 - h1);
+    d -= std::floor(d);
+    return std::min(d, 1 - d) <= hueReach;
+  }
+
+  // threads counts the calling one; 0 means one per hardware thread
+  void threads(int n)
+  {
+    if (!pool || (n > 0 && pool->size() != n))
+    {
+      pool.reset(new ThreadPool(n));
+    }
+  }
+
+  void compute()
+  {
+    threads(0);
+    std::fill(fx.begin(), fx.end(), 0.0f);
+    std::fill(fy.begin(), fy.end(), 0.0f);
+    std::fill(fz.begin(), fz.end(), 0.0f);
+    if (mode == EXACT)
+    {
+      computeExact();
+      return;
+    }
+    if (mode == NEIGHBORS)
+    {
+      computeNeighbors();
+      return;
+    }
+    buildTree();
+    // particles in tree order, so neighbours walk the same nodes
+    pool->parallelFor(size(), 256, [&](int begin, int end)
+                      {
+                        std::vector<int> stack;
+                        for (int s = begin; s < end; s++)
+                        {
+                          treeForce(order[s], stack);
+                        } });
+  }
+
+  // Particle i's force by summing every other particle, O(N). For
+  // checking either mode.
+  std::array<float, 3> exactForce(int i) const
+  {
+    std::array<float, 3> f = {0, 0, 0};
+    for (int j = 0; j < size(); j++)
+    {
+      if (j != i)
+      {
+        addPair(i, x[j], y[j], z[j], hue[j], f);
+      }
+    }
+    return f;
+  }
+
+  int nodeCount() const { return (int)nodes.size(); }
+
+private:
+  struct Node
+  {
+    float cx, cy, cz, half; // the cube it covers
+    int begin, end;         // its particles, in `order`
+    int firstChild = -1, childCount = 0;
+    int moments = -1; // index into `moments`
+    float n = 0, mx, my, mz; // particle count and centre
+  };
+
+  // a count and a position sum
+  struct Moment
+  {
+    float n = 0, x = 0, y = 0, z = 0;
+
+    Moment &operator+=(const Moment &m)
+    {
+      n += m.n;
+      x += m.x;
+      y += m.y;
+      z += m.z;
+      return *this;
+    }
+    Moment operator-(const Moment &m) const
+    {
+      return {n - m.n, x - m.x, y - m.y, z - m.z};
+    }
+    Moment operator*(float s) const { return {n * s, x * s, y * s, z * s}; }
+  };
+
+  // What a particle at (px, py, pz) with hue h does to particle i.
+  void addPair(int i, float px, float py, float pz, float h,
+               std::array<float, 3> &f) const
+  {
+    float dx = px - x[i], dy = py - y[i], dz = pz - z[i];
+    float r2 = dx * dx + dy * dy + dz * dz;
+    if (r2 == 0)
+    {
+      return; // no direction to push in
+    }
+    float sign = hueAttracts(hue[i], h) ? -1 : 1;
+    if (r2 < flipDistance * flipDistance)
+    {
+      sign = -sign;
+    }
+    float s = -sign / (std::sqrt(r2) * (r2 + softening));
+    f[0] += dx * s;
+    f[1] += dy * s;
+    f[2] += dz * s;
+  }
+
+  // Every pair once, equal and opposite, like the original loop: first
+  // each tile with itself, then the rounds of tile pairs.
+  void computeExact()
+  {
+    int tiles = (size() + tile - 1) / tile;
+    pool->parallelFor(tiles, 1, [&](int begin, int end)
+                      {
+                        for (int t = begin; t < end; t++)
+                        {
+                          tilePair(t, t);
+                        } });
+
+    // The circle method: with m tiles (one more, a bye, if odd) there are
+    // m - 1 rounds. In round r tile m - 1 meets r, and r + k meets r - k
+    // (mod m - 1) for k = 1 ... m / 2 - 1.
+    int m = tiles + tiles % 2;
+    for (int r = 0; r < m - 1; r++)
+    {
+      pool->parallelFor(m / 2, 1, [&](int begin, int end)
+                        {
+                          for (int k = begin; k < end; k++)
+                          {
+                            int a = k == 0 ? m - 1 : (r + k) % (m - 1);
+                            int b = (r - k + m - 1) % (m - 1);
+                            if (a < tiles && b < tiles)
+                            {
+                              tilePair(std::min(a, b), std::max(a, b));
+                            }
+                          } });
+    }
+  }
+
+  // Every pair between tiles it and jt once (it <= jt).
+  void tilePair(int it, int jt)
+  {
+    int n = size();
+    int ib = it * tile, jb = jt * tile;
+    int iEnd = std::min(ib + tile, n), jEnd = std::min(jb + tile, n);
+    for (int i = ib; i < iEnd; i++)
+    {
+      int j = it == jt ? i + 1 : jb;
+      float f[3] = {0, 0, 0};
+      pairKernel(jEnd - j, x[i], y[i], z[i], hue[i], &x[j], &y[j], &z[j],
+                 &hue[j], &fx[j], &fy[j], &fz[j], f);
+      fx[i] += f[0];
+      fy[i] += f[1];
+      fz[i] += f[2];
+    }
+  }
+
+  // The force a pair puts on its first particle is (dx, dy, dz) times
+  // this, where (dx, dy, dz) runs from the first to the second. Hues in
+  // [0, 1). Selects only, so loops calling it stay branch free.
+  static float pairScale(float dx, float dy, float dz, float h1, float h2)
+  {
+    float r2 = dx * dx + dy * dy + dz * dz;
+    float dh = std::fabs(h2 - h1);
+    dh = std::min(dh, 1 - dh);
+    float sign = dh <= hueReach ? 1.0f : -1.0f; // already negated
+    sign = r2 < flipDistance * flipDistance ? -sign : sign;
+    // at r2 = 0 this is finite and dx, dy, dz are 0, so no force
+    return sign * rsqrt(r2) / (r2 + softening);
+  }
+
+  // Particles [0, n) of (x, y, z, hue) against the one at (px, py, pz)
+  // with hue ph: their forces are added to (fx, fy, fz), its force to
+  // out. A function of its own so restrict is honored, as in PhysarumSim.
+  static void pairKernel(int n, float px, float py, float pz, float ph,
+                         const float *__restrict x, const float *__restrict y,
+                         const float *__restrict z,
+                         const float *__restrict hue, float *__restrict fx,
+                         float *__restrict fy, float *__restrict fz,
+                         float *__restrict out)
+  {
+    // without -ffast-math a single running sum would keep the loop
+    // scalar, so each lane keeps its own
+    float sx[lanes] = {0}, sy[lanes] = {0}, sz[lanes] = {0};
+    int k = 0;
+    for (; k + lanes <= n; k += lanes)
+    {
+      for (int l = 0; l < lanes; l++)
+      {
+        float dx = x[k + l] - px, dy = y[k + l] - py, dz = z[k + l] - pz;
+        float s = pairScale(dx, dy, dz, ph, hue[k + l]);
+        sx[l] += dx * s;
+        sy[l] += dy * s;
+        sz[l] += dz * s;
+        fx[k + l] -= dx * s;
+        fy[k + l] -= dy * s;
+        fz[k + l] -= dz * s;
+      }
+    }
+    for (; k < n; k++)
+    {
+      float dx = x[k] - px, dy = y[k] - py, dz = z[k] - pz;
+      float s = pairScale(dx, dy, dz, ph, hue[k]);
+      sx[0] += dx * s;
+      sy[0] += dy * s;
+      sz[0] += dz * s;
+      fx[k] -= dx * s;
+      fy[k] -= dy * s;
+      fz[k] -= dz * s;
+    }
+    for (int l = 0; l < lanes; l++)
+    {
+      out[0] += sx[l];
+      out[1] += sy[l];
+      out[2] += sz[l];
+    }
+  }
+
+  // Particle i's force from n particles in a row, within the cutoff of it
+  // at (px, py, pz). Like pairKernel, but only i's force is written. The
+  // particle itself may be among them; its dx, dy, dz are 0, so it adds
+  // nothing.
+  static void rowKernel(int n, float cut2, float px, float py, float pz,
+                        float ph, const float *__restrict x,
+                        const float *__restrict y, const float *__restrict z,
+                        const float *__restrict hue, float *__restrict out)
+  {
+    float sx[lanes] = {0}, sy[lanes] = {0}, sz[lanes] = {0};
+    int k = 0;
+    for (; k + lanes <= n; k += lanes)
+    {
+      for (int l = 0; l < lanes; l++)
+      {
+        float dx = x[k + l] - px, dy = y[k + l] - py, dz = z[k + l] - pz;
+        float s = pairScale(dx, dy, dz, ph, hue[k + l]);
+        s = dx * dx + dy * dy + dz * dz < cut2 ? s : 0.0f;
+        sx[l] += dx * s;
+        sy[l] += dy * s;
+        sz[l] += dz * s;
+      }
+    }
+    for (; k < n; k++)
+    {
+      float dx = x[k] - px, dy = y[k] - py, dz = z[k] - pz;
+      float s = pairScale(dx, dy, dz, ph, hue[k]);
+      s = dx * dx + dy * dy + dz * dz < cut2 ? s : 0.0f;
+      sx[0] += dx * s;
+      sy[0] += dy * s;
+      sz[0] += dz * s;
+    }
+    for (int l = 0; l < lanes; l++)
+    {
+      out[0] += sx[l];
+      out[1] += sy[l];
+      out[2] += sz[l];
+    }
+  }
+
+  // Sums the pairs within the cutoff.
+  //
+  // The particles go into cells at least cutoff wide by a counting sort,
+  // with copies of their positions in cell order, so the cells x - 1 to
+  // x + 1 of a row are one run of memory: each particle reads 9 runs,
+  // each summed by rowKernel. A particle adds up its runs in the same
+  // order on any thread count.
+  void computeNeighbors()
+  {
+    int n = size();
+    if (n == 0)
+    {
+      return;
+    }
+
+    float hi[3] = {x[0], y[0], z[0]};
+    std::copy(hi, hi + 3, gridLo);
+    for (int i = 1; i < n; i++)
+    {
+      float p[3] = {x[i], y[i], z[i]};
+      for (int c = 0; c < 3; c++)
+      {
+        gridLo[c] = std::min(gridLo[c], p[c]);
+        hi[c] = std::max(hi[c], p[c]);
+      }
+    }
+    float extent = std::max(
+        {hi[0] - gridLo[0], hi[1] - gridLo[1], hi[2] - gridLo[2]});
+    gridWidth = std::max(cutoff, extent / maxCells * 1.0001f);
+    for (int c = 0; c < 3; c++)
+    {
+      gridDims[c] =
+          std::min((int)((hi[c] - gridLo[c]) / gridWidth) + 1, maxCells);
+    }
+
+    // counting sort of the particles by cell
+    int cells = gridDims[0] * gridDims[1] * gridDims[2];
+    cellStart.assign(cells + 1, 0);
+    scratch.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+      int cell[3];
+      cellOf(x[i], y[i], z[i], cell);
+      scratch[i] = cellIndex(cell);
+      cellStart[scratch[i] + 1]++;
+    }
+    for (int c = 0; c < cells; c++)
+    {
+      cellStart[c + 1] += cellStart[c];
+    }
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    cellParticles.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+      cellParticles[fill[scratch[i]]++] = i;
+    }
+    for (auto *a : {&cellX, &cellY, &cellZ, &cellHue})
+    {
+      a->resize(n);
+    }
+    for (int s = 0; s < n; s++)
+    {
+      int i = cellParticles[s];
+      cellX[s] = x[i];
+      cellY[s] = y[i];
+      cellZ[s] = z[i];
+      cellHue[s] = hue[i];
+    }
+
+    float cut2 = cutoff * cutoff;
+    pool->parallelFor(n, neighborGrain, [&](int begin, int end)
+                      {
+                        for (int s = begin; s < end; s++)
+                        {
+                          sumNeighbors(s, cut2);
+                        } });
+  }
+
+  void cellOf(float px, float py, float pz, int *cell) const
+  {
+    float p[3] = {px, py, pz};
+    for (int c = 0; c < 3; c++)
+    {
+      cell[c] =
+          std::min((int)((p[c] - gridLo[c]) / gridWidth), gridDims[c] - 1);
+    }
+  }
+
+  int cellIndex(const int *cell) const
+  {
+    return (cell[2] * gridDims[1] + cell[1]) * gridDims[0] + cell[0];
+  }
+
+  // Particle s (in cell order): its force, from the cells around it.
+  void sumNeighbors(int s, float cut2)
+  {
+    int cell[3];
+    cellOf(cellX[s], cellY[s], cellZ[s], cell);
+    int x0 = std::max(cell[0] - 1, 0);
+    int x1 = std::min(cell[0] + 1, gridDims[0] - 1);
+    float f[3] = {0, 0, 0};
+    for (int cz = std::max(cell[2] - 1, 0);
+         cz <= std::min(cell[2] + 1, gridDims[2] - 1); cz++)
+    {
+      for (int cy = std::max(cell[1] - 1, 0);
+           cy <= std::min(cell[1] + 1, gridDims[1] - 1); cy++)
+      {
+        int from[3] = {x0, cy, cz}, to[3] = {x1, cy, cz};
+        int first = cellStart[cellIndex(from)];
+        int last = cellStart[cellIndex(to) + 1];
+        rowKernel(last - first, cut2, cellX[s], cellY[s], cellZ[s],
+                  cellHue[s], &cellX[first], &cellY[first], &cellZ[first],
+                  &cellHue[first], f);
+      }
+    }
+    int i = cellParticles[s];
+    fx[i] = f[0];
+    fy[i] = f[1];
+    fz[i] = f[2];
+  }
+
+  static int binOf(float h)
+  {
+    int b = (int)((h - std::floor(h)) * hueBins);
+    return std::min(b, hueBins - 1);
+  }
+
+  void buildTree()
+  {
+    int n = size();
+    nodes.clear();
+    moments.clear();
+    order.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+      order[i] = i;
+    }
+    if (n == 0)
+    {
+      return;
+    }
+    float lo[3] = {x[0], y[0], z[0]}, hi[3] = {x[0], y[0], z[0]};
+    for (int i = 1; i < n; i++)
+    {
+      float p[3] = {x[i], y[i], z[i]};
+      for (int c = 0; c < 3; c++)
+      {
+        lo[c] = std::min(lo[c], p[c]);
+        hi[c] = std::max(hi[c], p[c]);
+      }
+    }
+    float half = 0;
+    for (int c = 0; c < 3; c++)
+    {
+      half = std::max(half, (hi[c] - lo[c]) / 2);
+    }
+    Node root;
+    root.cx = (lo[0] + hi[0]) / 2;
+    root.cy = (lo[1] + hi[1]) / 2;
+    root.cz = (lo[2] + hi[2]) / 2;
+    root.half = half * 1.0001f + 1e-6f; // strictly inside
+    root.begin = 0;
+    root.end = n;
+    nodes.push_back(root);
+    split(0, 0);
+  }
+
+  // Splits node k into its non-empty octants, which are stored next to
+  // each other, and so on down to the leaves.
+  void split(int k, int depth)
+  {
+    addMoments(k);
+    Node node = nodes[k];
+    if (node.end - node.begin <= leafSize || depth == maxDepth)
+    {
+      return;
+    }
+
+    auto octant = [&](int i)
+    {
+      return (x[i] >= node.cx) | (y[i] >= node.cy) << 1 |
+             (z[i] >= node.cz) << 2;
+    };
+    // counting sort of the node's particles by octant
+    int count[8] = {0};
+    for (int s = node.begin; s < node.end; s++)
+    {
+      count[octant(order[s])]++;
+    }
+    int start[9] = {node.begin};
+    for (int o = 0; o < 8; o++)
+    {
+      start[o + 1] = start[o] + count[o];
+    }
+    scratch.assign(order.begin() + node.begin, order.begin() + node.end);
+    int fill[8];
+    std::copy(start, start + 8, fill);
+    for (int i : scratch)
+    {
+      order[fill[octant(i)]++] = i;
+    }
+
+    int first = (int)nodes.size();
+    float h = node.half / 2;
+    for (int o = 0; o < 8; o++)
+    {
+      if (count[o] == 0)
+      {
+        continue;
+      }
+      Node child;
+      child.cx = node.cx + (o & 1 ? h : -h);
+      child.cy = node.cy + (o & 2 ? h : -h);
+      child.cz = node.cz + (o & 4 ? h : -h);
+      child.half = h;
+      child.begin = start[o];
+      child.end = start[o + 1];
+      nodes.push_back(child);
+    }
+    nodes[k].firstChild = first;
+    nodes[k].childCount = (int)nodes.size() - first;
+    for (int c = first; c < first + nodes[k].childCount; c++)
+    {
+      split(c, depth + 1);
+    }
+  }
+
+  // Node k's per-bin sums, as prefix sums: entry b is bins [0, b).
+  void addMoments(int k)
+  {
+    nodes[k].moments = (int)moments.size();
+    moments.resize(moments.size() + hueBins + 1);
+    Moment *m = &moments[nodes[k].moments];
+    for (int s = nodes[k].begin; s < nodes[k].end; s++)
+    {
+      int i = order[s];
+      m[binOf(hue[i]) + 1] += Moment{1, x[i], y[i], z[i]};
+    }
+    for (int b = 0; b < hueBins; b++)
+    {
+      m[b + 1] += m[b];
+    }
+    Node &node = nodes[k];
+    node.n = m[hueBins].n;
+    node.mx = m[hueBins].x / node.n;
+    node.my = m[hueBins].y / node.n;
+    node.mz = m[hueBins].z / node.n;
+  }
+
+  // bins [b0, b1) of a prefix array, wrapping around the wheel; b1 - b0
+  // is at most hueBins
+  static Moment binRange(const Moment *m, int b0, int b1)
+  {
+    int length = b1 - b0;
+    b0 = ((b0 % hueBins) + hueBins) % hueBins;
+    if (b0 + length <= hueBins)
+    {
+      return m[b0 + length] - m[b0];
+    }
+    Moment r = m[hueBins] - m[b0];
+    r += m[b0 + length - hueBins];
+    return r;
+  }
+
+  // m.n particles at their centre, each pushing particle i away with
+  // `weight` (pulling, for a negative weight)
+  void addMoment(int i, const Moment &m, float weight,
+                 std::array<float, 3> &f) const
+  {
+    if (m.n <= 0)
+    {
+      return;
+    }
+    float dx = m.x / m.n - x[i], dy = m.y / m.n - y[i], dz = m.z / m.n - z[i];
+    float r2 = dx * dx + dy * dy + dz * dz;
+    float s = -weight * m.n / (std::sqrt(r2) * (r2 + softening));
+    f[0] += dx * s;
+    f[1] += dy * s;
+    f[2] += dz * s;
+  }
+
+  // Writes only particle i's force, so ranges of particles can run at
+  // once, each with its own stack.
+  void treeForce(int i, std::vector<int> &stack)
+  {
+    std::array<float, 3> f = {0, 0, 0};
+
+    // particle i's arc of attracting hues, in bins: [a, e), the whole
+    // bins strictly between lo and hi, and what fraction of lo and hi
+    float a = (hue[i] - hueReach) * hueBins, e = (hue[i] + hueReach) * hueBins;
+    int lo = (int)std::floor(a), hi = (int)std::floor(e);
+    float loPart = lo + 1 - a, hiPart = e - hi;
+
+    float theta2 = theta * theta;
+    float flip2 = flipDistance * flipDistance;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+
+      // the nearest point of the cube: nothing inside is closer
+      float gap2 = 0;
+      for (float d : {std::fabs(x[i] - node.cx), std::fabs(y[i] - node.cy),
+                      std::fabs(z[i] - node.cz)})
+      {
+        float g = std::max(d - node.half, 0.0f);
+        gap2 += g * g;
+      }
+      float dx = node.mx - x[i], dy = node.my - y[i], dz = node.mz - z[i];
+      float r2 = dx * dx + dy * dy + dz * dz;
+      float width = 2 * node.half;
+      if (gap2 > flip2 && width * width < theta2 * r2)
+      {
+        // all of them, then the arc
+        float s = -node.n / (std::sqrt(r2) * (r2 + softening));
+        f[0] += dx * s;
+        f[1] += dy * s;
+        f[2] += dz * s;
+        const Moment *m = &moments[node.moments];
+        Moment near = binRange(m, lo + 1, hi);
+        near += binRange(m, lo, lo + 1) * loPart;
+        near += binRange(m, hi, hi + 1) * hiPart;
+        addMoment(i, near, -2, f);
+        continue;
+      }
+
+      if (node.childCount > 0)
+      {
+        for (int c = node.firstChild; c < node.firstChild + node.childCount;
+             c++)
+        {
+          stack.push_back(c);
+        }
+        continue;
+      }
+      // a leaf too close to use whole
+      for (int s = node.begin; s < node.end; s++)
+      {
+        int j = order[s];
+        if (j != i)
+        {
+          addPair(i, x[j], y[j], z[j], hue[j], f);
+        }
+      }
+    }
+    fx[i] = f[0];
+    fy[i] = f[1];
+    fz[i] = f[2];
+  }
+
+  std::vector<Node> nodes;
+  std::vector<Moment> moments; // hueBins + 1 per node
+  std::vector<int> order, scratch;
+  // NEIGHBORS: in cell order, particle s is cellParticles[s], at cellX,
+  // cellY, cellZ
+  std::vector<int> cellStart, cellParticles;
+  aligned_vector<float> cellX, cellY, cellZ, cellHue;
+  float gridLo[3], gridWidth;
+  int gridDims[3];
+  std::unique_ptr<ThreadPool> pool;
+};
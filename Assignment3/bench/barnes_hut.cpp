@@ -0,0 +1,122 @@
+// Times HueCharges' Barnes-Hut mode and reports its error against the exact
+// O(N^2) sum, for a few opening angles.
+//
+// Two layouts: the cube of half-width 5 the app starts from, and the
+// sphere of radius 2 the springs then pull the particles onto. The error
+// is |F - F_exact| / |F_exact| per particle over a sample of them, and
+// the rms error is the same over the whole sample's forces. Above 20000
+// particles the exact time is estimated from the sample.
+//
+// build: g++ -O3 -march=native -std=c++17 barnes_hut.cpp -o barnes_hut
+// usage: ./barnes_hut [particles] [sample]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/Philox.hpp"
+#include "../HueCharges.hpp"
+
+void scatter(HueCharges &charges, int n, bool sphere)
+{
+  Philox rng(1);
+  charges.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    auto p = rng.uniformS3(i, 0, 0);
+    float s = 5;
+    if (sphere)
+    {
+      // a shell of radius 2, .02 thick
+      float m = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]) + 1e-6f;
+      s = (2 + .02f * rng.uniform(i, 0, 1)) / m;
+    }
+    charges.x[i] = p[0] * s;
+    charges.y[i] = p[1] * s;
+    charges.z[i] = p[2] * s;
+    charges.hue[i] = rng.uniform(i, 0, 2);
+  }
+}
+
+double seconds(HueCharges &charges)
+{
+  auto start = std::chrono::steady_clock::now();
+  charges.compute();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void run(int n, int sampleSize, bool sphere)
+{
+  HueCharges charges;
+  scatter(charges, n, sphere);
+
+  // every particle, or an even spread of them
+  std::vector<int> sample;
+  int step = std::max(1, n / sampleSize);
+  for (int i = 0; i < n; i += step)
+  {
+    sample.push_back(i);
+  }
+  std::vector<std::array<float, 3>> exact;
+  auto start = std::chrono::steady_clock::now();
+  for (int i : sample)
+  {
+    exact.push_back(charges.exactForce(i));
+  }
+  double exactSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count() *
+      n / sample.size() / 2; // the full sum does each pair once
+  const char *estimated = " (est.)";
+  if (n <= 20000)
+  {
+    charges.mode = EXACT;
+    exactSeconds = seconds(charges);
+    estimated = "";
+  }
+  printf("%s, %d particles: exact %.3f s%s\n", sphere ? "sphere" : "cube", n,
+         exactSeconds, estimated);
+  printf("%6s %10s %8s %10s %10s %10s %10s\n", "theta", "seconds", "speedup",
+         "nodes", "median", "99%", "rms");
+
+  charges.mode = BARNES_HUT;
+  for (float theta : {0.3f, 0.5f, 0.7f, 1.0f})
+  {
+    charges.theta = theta;
+    double s = seconds(charges);
+    std::vector<float> errors;
+    double diff2 = 0, norm2 = 0;
+    for (int k = 0; k < (int)sample.size(); k++)
+    {
+      int i = sample[k];
+      float d[3] = {charges.fx[i] - exact[k][0], charges.fy[i] - exact[k][1],
+                    charges.fz[i] - exact[k][2]};
+      float e2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+      float f2 = exact[k][0] * exact[k][0] + exact[k][1] * exact[k][1] +
+                 exact[k][2] * exact[k][2];
+      errors.push_back(std::sqrt(e2 / f2));
+      diff2 += e2;
+      norm2 += f2;
+    }
+    std::sort(errors.begin(), errors.end());
+    printf("%6.2f %10.3f %7.1fx %10d %10.2e %10.2e %10.2e\n", theta, s,
+           exactSeconds / s, charges.nodeCount(), errors[errors.size() / 2],
+           errors[errors.size() * 99 / 100], std::sqrt(diff2 / norm2));
+  }
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 20000;
+  int sample = argc > 2 ? atoi(argv[2]) : 1000;
+  for (bool sphere : {false, true})
+  {
+    run(n, sample, sphere);
+  }
+}
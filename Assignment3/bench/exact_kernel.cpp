@@ -0,0 +1,191 @@
+// Times the all-pairs charge force three ways and checks that they agree:
+//
+//   loop    as particle.cpp had it: hues converted back from the RGB
+//           colours for every pair, sin() in double, normalize()
+//   scalar  HueCharges::exactForce() for every particle: cached hues,
+//           one particle at a time, both halves of every pair
+//   tiled   HueCharges' EXACT mode: the vectorized tile kernel
+//
+// Errors are relative to `loop`, over all forces (rms) and per particle
+// (max).
+//
+// build: g++ -O3 -march=native -std=c++17 exact_kernel.cpp -o exact_kernel
+// usage: ./exact_kernel [particles]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/Philox.hpp"
+#include "../HueCharges.hpp"
+
+struct Rgb
+{
+  float r, g, b;
+};
+
+// what al::RGB(al::HSV(h, 1, 1)) gives
+Rgb fromHue(float h)
+{
+  float h6 = h * 6;
+  int sector = (int)h6;
+  float f = h6 - sector, q = 1 - f, t = f;
+  switch (sector)
+  {
+  case 0:
+    return {1, t, 0};
+  case 1:
+    return {q, 1, 0};
+  case 2:
+    return {0, 1, t};
+  case 3:
+    return {0, q, 1};
+  case 4:
+    return {t, 0, 1};
+  default:
+    return {1, 0, q};
+  }
+}
+
+// what al::HSV(rgb).h gives
+float hueOf(const Rgb &c)
+{
+  float mx = std::max({c.r, c.g, c.b}), mn = std::min({c.r, c.g, c.b});
+  float delta = mx - mn;
+  if (delta == 0 || mx == 0)
+  {
+    return 0;
+  }
+  float h;
+  if (c.r == mx)
+  {
+    h = (c.g - c.b) / delta;
+  }
+  else if (c.g == mx)
+  {
+    h = 2 + (c.b - c.r) / delta;
+  }
+  else
+  {
+    h = 4 + (c.r - c.g) / delta;
+  }
+  if (h < 0)
+  {
+    h += 6;
+  }
+  return h / 6;
+}
+
+void oldLoop(const HueCharges &c, const std::vector<Rgb> &colors,
+             std::vector<float> &fx, std::vector<float> &fy,
+             std::vector<float> &fz)
+{
+  int n = c.size();
+  fx.assign(n, 0);
+  fy.assign(n, 0);
+  fz.assign(n, 0);
+  for (int i = 0; i < n; i++)
+  {
+    for (int j = i + 1; j < n; j++)
+    {
+      float h1 = hueOf(colors[i]), h2 = hueOf(colors[j]);
+      float asymCharge = (std::abs(std::sin((h2 - h1) * M_PI)) > .08) * 2.0 - 1.0;
+      float dir[3] = {c.x[j] - c.x[i], c.y[j] - c.y[i], c.z[j] - c.z[i]};
+      float mag2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+      if (std::sqrt(mag2) < .07)
+      {
+        asymCharge *= -1;
+      }
+      float mag = std::sqrt(mag2);
+      float f[3];
+      for (int k = 0; k < 3; k++)
+      {
+        f[k] = (dir[k] / mag * asymCharge) / (mag2 + .001f);
+      }
+      fx[i] -= f[0];
+      fy[i] -= f[1];
+      fz[i] -= f[2];
+      fx[j] += f[0];
+      fy[j] += f[1];
+      fz[j] += f[2];
+    }
+  }
+}
+
+template <class F>
+double seconds(F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void compare(const char *name, double s, double base, const HueCharges &c,
+             const std::vector<float> &fx, const std::vector<float> &fy,
+             const std::vector<float> &fz, const std::vector<float> &gx,
+             const std::vector<float> &gy, const std::vector<float> &gz)
+{
+  double diff2 = 0, norm2 = 0, worst = 0;
+  for (int i = 0; i < c.size(); i++)
+  {
+    double d2 = std::pow(fx[i] - gx[i], 2) + std::pow(fy[i] - gy[i], 2) +
+                std::pow(fz[i] - gz[i], 2);
+    double g2 = std::pow(gx[i], 2) + std::pow(gy[i], 2) + std::pow(gz[i], 2);
+    diff2 += d2;
+    norm2 += g2;
+    worst = std::max(worst, std::sqrt(d2 / g2));
+  }
+  printf("%8s %10.3f %8.1fx %10.2e %10.2e\n", name, s, base / s,
+         std::sqrt(diff2 / norm2), worst);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 10000;
+
+  // the app's starting layout
+  HueCharges c;
+  c.resize(n);
+  std::vector<Rgb> colors(n);
+  Philox rng(1), hues(1, 1);
+  for (int i = 0; i < n; i++)
+  {
+    auto p = rng.uniformS3(i, 0, 0);
+    c.x[i] = p[0] * 5;
+    c.y[i] = p[1] * 5;
+    c.z[i] = p[2] * 5;
+    colors[i] = fromHue(hues.uniform(i, 0));
+    c.hue[i] = hueOf(colors[i]);
+  }
+
+  std::vector<float> lx, ly, lz;
+  double base = seconds([&]
+                        { oldLoop(c, colors, lx, ly, lz); });
+
+  std::vector<float> sx(n), sy(n), sz(n);
+  double scalar = seconds([&]
+                          {
+                            for (int i = 0; i < n; i++)
+                            {
+                              auto f = c.exactForce(i);
+                              sx[i] = f[0];
+                              sy[i] = f[1];
+                              sz[i] = f[2];
+                            } });
+
+  c.mode = EXACT;
+  double tiled = seconds([&]
+                         { c.compute(); });
+  std::vector<float> tx(c.fx.begin(), c.fx.end()), ty(c.fy.begin(), c.fy.end()),
+      tz(c.fz.begin(), c.fz.end());
+
+  printf("%d particles\n", n);
+  printf("%8s %10s %9s %10s %10s\n", "", "seconds", "speedup", "rms", "max");
+  compare("loop", base, base, c, lx, ly, lz, lx, ly, lz);
+  compare("scalar", scalar, base, c, sx, sy, sz, lx, ly, lz);
+  compare("tiled", tiled, base, c, tx, ty, tz, lx, ly, lz);
+}
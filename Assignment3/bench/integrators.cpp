@@ -0,0 +1,252 @@
+// ParticleStepper's integrators on the Assignment3 forces: the spring to
+// radius 2, the hue charges and, as particle.cpp has it, acceleration
+// F / m^2 (so the kinetic energy is sum m^2 v^2 / 2).
+//
+// Three tables, each running the same simulated time per row:
+//   energy     full K and Ke, no drag, so energy should be conserved.
+//              `drift` is |E(T) - E(0)| / |E(0)|, `worst` the largest such
+//              gap along the way. The charge potential is
+//              -s atan(r / sqrt(eps)) / sqrt(eps) per pair, shifted inside
+//              the flip distance so it stays continuous.
+//   accuracy   with drag, against velocity Verlet at dt = .002. `rms` and
+//              `worst` are position errors at the end, in world units.
+//   stiff      K = 30, past the slider, where a fixed dt = .6 is unstable.
+// A run whose energy grows tenfold is stopped and counted as blown up.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread integrators.cpp
+//          -o integrators
+// usage: ./integrators [particles] [time]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/ParticleStepper.hpp"
+#include "../../common/Philox.hpp"
+#include "../HueCharges.hpp"
+
+struct Vec3
+{
+  float x = 0, y = 0, z = 0;
+
+  Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
+  Vec3 operator-(const Vec3 &v) const { return {x - v.x, y - v.y, z - v.z}; }
+  Vec3 &operator+=(const Vec3 &v)
+  {
+    x += v.x;
+    y += v.y;
+    z += v.z;
+    return *this;
+  }
+  float magSqr() const { return x * x + y * y + z * z; }
+};
+
+float K = 0.99f, Ke = 0.99f, drag = 0;
+
+struct Sim
+{
+  std::vector<Vec3> x, v;
+  std::vector<float> mass;
+  HueCharges charges;
+
+  explicit Sim(int n)
+  {
+    Philox rng(1);
+    x.resize(n);
+    v.resize(n);
+    charges.resize(n);
+    charges.threads(1);
+    for (int i = 0; i < n; i++)
+    {
+      auto p = rng.uniformS3(i, 0, 0), q = rng.uniformS3(i, 0, 1);
+      x[i] = {p[0] * 5, p[1] * 5, p[2] * 5};
+      v[i] = {q[0] * .1f, q[1] * .1f, q[2] * .1f};
+      mass.push_back(std::max(0.5f, 3 + rng.normal(i, 0, 2) / 2));
+      charges.hue[i] = rng.uniform(i, 0, 3);
+    }
+  }
+
+  void accel(const std::vector<Vec3> &x, const std::vector<Vec3> &v,
+             std::vector<Vec3> &a)
+  {
+    for (int i = 0; i < (int)x.size(); i++)
+    {
+      charges.x[i] = x[i].x;
+      charges.y[i] = x[i].y;
+      charges.z[i] = x[i].z;
+    }
+    charges.compute();
+    for (int i = 0; i < (int)x.size(); i++)
+    {
+      float r = std::sqrt(x[i].magSqr());
+      float k = K * (2 / r - 1); // the spring, (2 x / |x| - x) K
+      Vec3 f = {x[i].x * k + charges.fx[i] * .001f * Ke - v[i].x * drag,
+                x[i].y * k + charges.fy[i] * .001f * Ke - v[i].y * drag,
+                x[i].z * k + charges.fz[i] * .001f * Ke - v[i].z * drag};
+      a[i] = f * (1 / mass[i] / mass[i]);
+    }
+  }
+
+  double energy() const
+  {
+    const double soft = std::sqrt((double)HueCharges::softening);
+    const double flip = HueCharges::flipDistance;
+    double e = 0;
+    int n = (int)x.size();
+    for (int i = 0; i < n; i++)
+    {
+      double r = std::sqrt(x[i].magSqr());
+      e += 0.5 * mass[i] * mass[i] * v[i].magSqr();
+      e += 0.5 * K * (r - 2) * (r - 2);
+      for (int j = i + 1; j < n; j++)
+      {
+        double dx = x[j].x - x[i].x, dy = x[j].y - x[i].y,
+               dz = x[j].z - x[i].z;
+        double d = std::sqrt(dx * dx + dy * dy + dz * dz);
+        double s = HueCharges::hueAttracts(charges.hue[i], charges.hue[j])
+                       ? -1
+                       : 1;
+        double u = -s * std::atan(d / soft) / soft;
+        if (d < flip)
+        {
+          // sign flipped, and shifted to meet the outer branch at flip
+          u = s * std::atan(d / soft) / soft -
+              2 * s * std::atan(flip / soft) / soft;
+        }
+        e += .001 * Ke * u;
+      }
+    }
+    return e;
+  }
+};
+
+ParticleStepper<Vec3> stepperFor(const Sim &sim, Integrator integrator,
+                                 bool adaptive)
+{
+  ParticleStepper<Vec3> stepper;
+  stepper.integrator = integrator;
+  stepper.adaptive = adaptive;
+  float minMass = *std::min_element(sim.mass.begin(), sim.mass.end());
+  stepper.maxRate = std::max(drag / minMass / minMass, std::sqrt(K) / minMass);
+  return stepper;
+}
+
+// false if it blew up
+bool simulate(Sim &sim, ParticleStepper<Vec3> &stepper, float time, float dt,
+              double *worst = nullptr)
+{
+  double e0 = sim.energy();
+  int frames = (int)std::lround(time / dt);
+  for (int f = 0; f < frames; f++)
+  {
+    stepper.advance(sim.x, sim.v, dt, [&](auto &x, auto &v, auto &a)
+                    { sim.accel(x, v, a); });
+    if (f % 10 == 9 || f == frames - 1)
+    {
+      double e = sim.energy();
+      if (!(std::fabs(e) < 10 * std::fabs(e0)))
+      {
+        return false;
+      }
+      if (worst)
+      {
+        *worst = std::max(*worst, std::fabs(e - e0) / std::fabs(e0));
+      }
+    }
+  }
+  return true;
+}
+
+void energyRow(int n, float time, const char *name, Integrator integrator,
+               float dt, bool adaptive)
+{
+  Sim sim(n);
+  auto stepper = stepperFor(sim, integrator, adaptive);
+  double e0 = sim.energy(), worst = 0;
+  if (!simulate(sim, stepper, time, dt, &worst))
+  {
+    printf("%22s %6.2f %11ld %12s\n", name, dt, stepper.evaluations,
+           "blew up");
+    return;
+  }
+  printf("%22s %6.2f %11ld %12.2e %12.2e\n", name, dt, stepper.evaluations,
+         std::fabs(sim.energy() - e0) / std::fabs(e0), worst);
+}
+
+void accuracyRow(int n, float time, const std::vector<Vec3> &reference,
+                 const char *name, Integrator integrator, float dt,
+                 bool adaptive)
+{
+  Sim sim(n);
+  auto stepper = stepperFor(sim, integrator, adaptive);
+  if (!simulate(sim, stepper, time, dt))
+  {
+    printf("%22s %6.2f %11ld %12s\n", name, dt, stepper.evaluations,
+           "blew up");
+    return;
+  }
+  double sum = 0, worst = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double d2 = (sim.x[i] - reference[i]).magSqr();
+    sum += d2;
+    worst = std::max(worst, std::sqrt(d2));
+  }
+  printf("%22s %6.2f %11ld %12.2e %12.2e\n", name, dt, stepper.evaluations,
+         std::sqrt(sum / n), worst);
+}
+
+void header(const char *title, const char *error)
+{
+  printf("\n%s\n", title);
+  printf("%22s %6s %11s %12s %12s\n", "integrator", "dt", "evaluations",
+         error, "worst");
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 300;
+  float time = argc > 2 ? atof(argv[2]) : 60;
+  printf("%d particles\n", n);
+
+  header("energy: K = Ke = .99, no drag", "drift");
+  for (float dt : {0.6f, 0.3f, 0.1f, 0.03f})
+  {
+    energyRow(n, time, "semi-implicit euler", SEMI_IMPLICIT_EULER, dt, false);
+    energyRow(n, time, "velocity verlet", VELOCITY_VERLET, dt, false);
+  }
+  energyRow(n, time, "adaptive euler", SEMI_IMPLICIT_EULER, 0.6f, true);
+  energyRow(n, time, "adaptive verlet", VELOCITY_VERLET, 0.6f, true);
+
+  // a tenth of the time: positions diverge chaotically past that
+  drag = 0.8f;
+  float shortTime = time / 10;
+  Sim reference(n);
+  auto exact = stepperFor(reference, VELOCITY_VERLET, false);
+  simulate(reference, exact, shortTime, 0.002f);
+  header("accuracy: K = Ke = .99, drag .8", "rms");
+  for (float dt : {0.6f, 0.3f, 0.1f, 0.03f})
+  {
+    accuracyRow(n, shortTime, reference.x, "semi-implicit euler",
+                SEMI_IMPLICIT_EULER, dt, false);
+    accuracyRow(n, shortTime, reference.x, "velocity verlet",
+                VELOCITY_VERLET, dt, false);
+  }
+  accuracyRow(n, shortTime, reference.x, "adaptive euler",
+              SEMI_IMPLICIT_EULER, 0.6f, true);
+  accuracyRow(n, shortTime, reference.x, "adaptive verlet", VELOCITY_VERLET,
+              0.6f, true);
+
+  drag = 0;
+  K = 30;
+  header("stiff: K = 30, Ke = .99, no drag", "drift");
+  for (float dt : {0.6f, 0.2f, 0.1f})
+  {
+    energyRow(n, time, "semi-implicit euler", SEMI_IMPLICIT_EULER, dt, false);
+    energyRow(n, time, "velocity verlet", VELOCITY_VERLET, dt, false);
+  }
+  energyRow(n, time, "adaptive euler", SEMI_IMPLICIT_EULER, 0.6f, true);
+  energyRow(n, time, "adaptive verlet", VELOCITY_VERLET, 0.6f, true);
+}
@@ -0,0 +1,241 @@
+// HueCharges' NEIGHBORS mode: what the cutoff costs in accuracy and saves
+// in time, and how far particles move between force evaluations in a
+// running sim.
+//
+// Layouts: the cube of half-width 5 the app starts from and the sphere
+// of radius 2 the springs pull the particles onto, for a few cutoffs.
+// `neighbours` is the other particles within the cutoff, per particle,
+// and `force` one force pass. The speedup is EXACT's time over `force`.
+// The error is |F - F_exact| / |F_exact| per particle; rms the same over
+// all forces.
+//
+// Running: the app's dynamics (K = .4, Ke = .99, drag .8, dt = .5,
+// velocity Verlet), from the cube, with cutoff .5. The seconds are per
+// evaluation, against EXACT's. `moved` is how far the farthest-moving
+// particle went since the last evaluation, on average and at most: what
+// the skin of a Verlet list would need to cover for the list to outlast
+// one evaluation.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread neighbors.cpp
+//          -o neighbors
+// usage: ./neighbors [particles] [frames]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/ParticleStepper.hpp"
+#include "../../common/Philox.hpp"
+#include "../HueCharges.hpp"
+
+struct Vec3
+{
+  float x = 0, y = 0, z = 0;
+
+  Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
+  Vec3 operator-(const Vec3 &v) const { return {x - v.x, y - v.y, z - v.z}; }
+  Vec3 &operator+=(const Vec3 &v)
+  {
+    x += v.x;
+    y += v.y;
+    z += v.z;
+    return *this;
+  }
+  float magSqr() const { return x * x + y * y + z * z; }
+};
+
+template <class F>
+double seconds(F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void scatter(HueCharges &charges, int n, bool sphere)
+{
+  Philox rng(1);
+  charges.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    auto p = rng.uniformS3(i, 0, 0);
+    float s = 5;
+    if (sphere)
+    {
+      // a shell of radius 2, .02 thick
+      float m = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]) + 1e-6f;
+      s = (2 + .02f * rng.uniform(i, 0, 1)) / m;
+    }
+    charges.x[i] = p[0] * s;
+    charges.y[i] = p[1] * s;
+    charges.z[i] = p[2] * s;
+    charges.hue[i] = rng.uniform(i, 0, 2);
+  }
+}
+
+// ordered pairs closer than cutoff
+long within(const HueCharges &charges, float cutoff)
+{
+  long count = 0;
+  for (int i = 0; i < charges.size(); i++)
+  {
+    for (int j = 0; j < charges.size(); j++)
+    {
+      float dx = charges.x[j] - charges.x[i], dy = charges.y[j] - charges.y[i],
+            dz = charges.z[j] - charges.z[i];
+      count += j != i && dx * dx + dy * dy + dz * dz < cutoff * cutoff;
+    }
+  }
+  return count;
+}
+
+void layout(int n, bool sphere)
+{
+  HueCharges charges;
+  scatter(charges, n, sphere);
+  charges.mode = EXACT;
+  double exactSeconds = seconds([&]
+                                { charges.compute(); });
+  std::vector<float> ex(charges.fx.begin(), charges.fx.end()),
+      ey(charges.fy.begin(), charges.fy.end()),
+      ez(charges.fz.begin(), charges.fz.end());
+
+  printf("\n%s, %d particles: exact %.3f s\n", sphere ? "sphere" : "cube", n,
+         exactSeconds);
+  printf("%6s %10s %10s %8s %10s %10s\n", "cutoff", "neighbours", "force",
+         "speedup", "median", "rms");
+  charges.mode = NEIGHBORS;
+  for (float cutoff : {0.25f, 0.5f, 1.0f, 2.0f})
+  {
+    charges.cutoff = cutoff;
+    double force = seconds([&]
+                           { charges.compute(); });
+
+    std::vector<float> errors;
+    double diff2 = 0, norm2 = 0;
+    for (int i = 0; i < n; i++)
+    {
+      float d[3] = {charges.fx[i] - ex[i], charges.fy[i] - ey[i],
+                    charges.fz[i] - ez[i]};
+      float e2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+      float f2 = ex[i] * ex[i] + ey[i] * ey[i] + ez[i] * ez[i];
+      errors.push_back(std::sqrt(e2 / f2));
+      diff2 += e2;
+      norm2 += f2;
+    }
+    std::sort(errors.begin(), errors.end());
+    printf("%6.2f %10.1f %10.4f %7.1fx %10.2e %10.2e\n", cutoff,
+           (double)within(charges, cutoff) / n, force, exactSeconds / force,
+           errors[n / 2], std::sqrt(diff2 / norm2));
+  }
+}
+
+struct Sim
+{
+  std::vector<Vec3> x, v;
+  std::vector<float> mass;
+  HueCharges charges;
+  float K = 0.4f, Ke = 0.99f, drag = 0.8f;
+  // the farthest any particle moved between evaluations
+  std::vector<Vec3> lastX;
+  double movedSum = 0, movedMax = 0;
+  int moves = 0;
+
+  explicit Sim(int n)
+  {
+    Philox rng(1);
+    x.resize(n);
+    v.resize(n);
+    charges.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+      auto p = rng.uniformS3(i, 0, 0), q = rng.uniformS3(i, 0, 1);
+      x[i] = {p[0] * 5, p[1] * 5, p[2] * 5};
+      v[i] = {q[0] * .1f, q[1] * .1f, q[2] * .1f};
+      mass.push_back(std::max(0.5f, 3 + rng.normal(i, 0, 2) / 2));
+      charges.hue[i] = rng.uniform(i, 0, 3);
+    }
+  }
+
+  // as particle.cpp's accelerations()
+  void accel(const std::vector<Vec3> &x, const std::vector<Vec3> &v,
+             std::vector<Vec3> &a)
+  {
+    if (lastX.size() == x.size())
+    {
+      float moved2 = 0;
+      for (int i = 0; i < (int)x.size(); i++)
+      {
+        moved2 = std::max(moved2, (x[i] - lastX[i]).magSqr());
+      }
+      movedSum += std::sqrt(moved2);
+      movedMax = std::max(movedMax, (double)std::sqrt(moved2));
+      moves++;
+    }
+    lastX = x;
+    for (int i = 0; i < (int)x.size(); i++)
+    {
+      charges.x[i] = x[i].x;
+      charges.y[i] = x[i].y;
+      charges.z[i] = x[i].z;
+    }
+    charges.compute();
+    for (int i = 0; i < (int)x.size(); i++)
+    {
+      float r = std::sqrt(x[i].magSqr());
+      float k = K * (2 / r - 1); // the spring, (2 x / |x| - x) K
+      Vec3 f = {x[i].x * k + charges.fx[i] * .001f * Ke - v[i].x * drag,
+                x[i].y * k + charges.fy[i] * .001f * Ke - v[i].y * drag,
+                x[i].z * k + charges.fz[i] * .001f * Ke - v[i].z * drag};
+      a[i] = f * (1 / mass[i] / mass[i]);
+    }
+  }
+};
+
+// seconds per force evaluation
+double running(int n, int frames, ForceMode mode, double base)
+{
+  Sim sim(n);
+  sim.charges.mode = mode;
+  ParticleStepper<Vec3> stepper;
+  stepper.integrator = VELOCITY_VERLET;
+  double s = seconds([&]
+                     {
+                       for (int f = 0; f < frames; f++)
+                       {
+                         stepper.advance(sim.x, sim.v, 0.5f,
+                                         [&](auto &x, auto &v, auto &a)
+                                         { sim.accel(x, v, a); });
+                       } }) /
+             stepper.evaluations;
+  if (mode == EXACT)
+  {
+    printf("%9s %10.4f %8s\n", "exact", s, "");
+    return s;
+  }
+  printf("%9s %10.4f %7.1fx %10.3f %10.3f\n", "neighbors", s, base / s,
+         sim.movedSum / sim.moves, sim.movedMax);
+  return s;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 20000;
+  int frames = argc > 2 ? atoi(argv[2]) : 50;
+  for (bool sphere : {false, true})
+  {
+    layout(n, sphere);
+  }
+
+  printf("\nrunning, %d particles, %d frames, cutoff .5\n", n, frames);
+  printf("%9s %10s %8s %10s %10s\n", "mode", "seconds", "speedup",
+         "moved", "most");
+  // a few frames are enough to time EXACT
+  double base = running(n, std::min(frames, 3), EXACT, 0);
+  running(n, frames, NEIGHBORS, base);
+}
@@ -0,0 +1,146 @@
+// Runs HueCharges on 1 to 16 threads and checks every thread count gives
+// bit-identical forces, in the EXACT and BARNES_HUT modes.
+//
+// Then, in every mode, it changes the thread count between two compute()
+// calls on one instance, with the particles moved in between. The second
+// call's forces must be bit-identical to a fresh instance's: scratch kept
+// per range must not depend on how the ranges fell last time. The exit
+// status is 1 if they are not.
+//
+// `balance` is how full the EXACT rounds keep that many threads: tile
+// pairs per round over (rounds of parallelFor waves x threads). It is the
+// schedule's bound on the speedup, whatever the machine; the measured
+// speedup only means something with that many cores.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread parallel_forces.cpp
+//          -o parallel_forces
+// usage: ./parallel_forces [particles]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "../../common/Philox.hpp"
+#include "../HueCharges.hpp"
+
+double seconds(HueCharges &charges)
+{
+  auto start = std::chrono::steady_clock::now();
+  charges.compute();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+double balance(int n, int threads)
+{
+  int tiles = (n + HueCharges::tile - 1) / HueCharges::tile;
+  int m = tiles + tiles % 2;
+  double work = tiles, slots = (tiles + threads - 1) / threads * threads;
+  for (int r = 0; r < m - 1; r++)
+  {
+    int pairs = m / 2 - (tiles % 2); // the bye sits out once per round
+    work += pairs;
+    slots += (pairs + threads - 1) / threads * threads;
+  }
+  return work / slots;
+}
+
+// the app's starting layout, moved by `step` draws
+void scatter(HueCharges &charges, int n, int step)
+{
+  charges.resize(n);
+  Philox rng(1);
+  for (int i = 0; i < n; i++)
+  {
+    auto p = rng.uniformS3(i, 0, 0);
+    auto d = rng.uniformS3(i, step, 1);
+    float move = step > 0 ? 0.2f : 0;
+    charges.x[i] = p[0] * 5 + d[0] * move;
+    charges.y[i] = p[1] * 5 + d[1] * move;
+    charges.z[i] = p[2] * 5 + d[2] * move;
+    charges.hue[i] = rng.uniform(i, 0, 1);
+  }
+}
+
+bool sameForces(const HueCharges &a, const HueCharges &b)
+{
+  size_t bytes = a.fx.size() * sizeof(float);
+  return std::memcmp(a.fx.data(), b.fx.data(), bytes) == 0 &&
+         std::memcmp(a.fy.data(), b.fy.data(), bytes) == 0 &&
+         std::memcmp(a.fz.data(), b.fz.data(), bytes) == 0;
+}
+
+// true if going from `before` threads to `after` between two calls gives
+// what a fresh instance on `after` threads does
+bool switchThreads(int n, ForceMode mode, int before, int after)
+{
+  HueCharges reused, fresh;
+  reused.mode = fresh.mode = mode;
+  scatter(reused, n, 0);
+  reused.threads(before);
+  reused.compute();
+  scatter(reused, n, 1);
+  reused.threads(after);
+  reused.compute();
+
+  scatter(fresh, n, 1);
+  fresh.threads(after);
+  fresh.compute();
+  return sameForces(reused, fresh);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 20000;
+
+  HueCharges charges;
+  scatter(charges, n, 0);
+
+  printf("%d particles, %u hardware threads\n", n,
+         std::thread::hardware_concurrency());
+  printf("%11s %8s %10s %8s %8s %10s\n", "mode", "threads", "seconds",
+         "speedup", "balance", "identical");
+  for (ForceMode mode : {EXACT, BARNES_HUT})
+  {
+    charges.mode = mode;
+    std::vector<float> first;
+    double base = 0;
+    for (int threads : {1, 2, 4, 8, 16})
+    {
+      charges.threads(threads);
+      double s = seconds(charges);
+      std::vector<float> f(charges.fx.begin(), charges.fx.end());
+      f.insert(f.end(), charges.fy.begin(), charges.fy.end());
+      f.insert(f.end(), charges.fz.begin(), charges.fz.end());
+      if (threads == 1)
+      {
+        first = f;
+        base = s;
+      }
+      bool same = std::memcmp(f.data(), first.data(), f.size() * 4) == 0;
+      printf("%11s %8d %10.3f %7.2fx %8.2f %10s\n",
+             mode == EXACT ? "exact" : "barnes-hut", threads, s, base / s,
+             mode == EXACT ? balance(n, threads) : 1.0, same ? "yes" : "NO");
+    }
+  }
+
+  printf("\n%11s %8s %10s\n", "mode", "threads", "as fresh");
+  bool allSame = true;
+  for (ForceMode mode : {EXACT, BARNES_HUT, NEIGHBORS})
+  {
+    for (auto [before, after] : {std::pair(4, 1), std::pair(1, 4)})
+    {
+      bool same = switchThreads(n, mode, before, after);
+      allSame = allSame && same;
+      const char *names[] = {"exact", "barnes-hut", "neighbors"};
+      printf("%11s %5d->%d %10s\n", names[mode], before, after,
+             same ? "yes" : "NO");
+    }
+  }
+  return allSame ? 0 : 1;
+}
@@ -3,17 +3,30 @@
 
 #include "al/app/al_App.hpp"
 #include "al/app/al_GUIDomain.hpp"
-#include "al/math/al_Random.hpp"
 
 using namespace al;
 
 #include <fstream>
+#include <random>
 #include <vector>
 using namespace std;
 
-Vec3f randomVec3f(float scale)
+#include "../common/ParticleStepper.hpp"
+#include "../common/Philox.hpp"
+#include "HueCharges.hpp"
+
+// particles to make; the first command-line argument
+int numParticles = 1000;
+
+// keys every random draw; fix it to repeat a run
+uint64_t seed = random_device()();
+
+// A point in the cube of half-width `scale`: particle i's `draw`th at
+// `step`. It depends only on those and the seed, not on call order.
+Vec3f randomVec3f(uint32_t i, uint64_t step, uint32_t draw, float scale)
 {
-  return Vec3f(rnd::uniformS(), rnd::uniformS(), rnd::uniformS()) * scale;
+  auto v = Philox(seed).uniformS3(i, step, draw);
+  return Vec3f(v[0], v[1], v[2]) * scale;
 }
 string slurp(string fileName); // forward declaration
 
@@ -24,6 +37,11 @@ struct AlloApp : App
   Parameter dragFactor{"/dragFactor", "", 0.8, 0.0, 0.9};
   Parameter K{"/K", "", 0.4, 0.0, .99};
   Parameter Ke{"/Ke", "", 0.0, 0.0, .99};
+  ParameterMenu forceMode{"/forceMode"};
+  Parameter theta{"/theta", "", 0.5, 0.1, 1.2}; // Barnes-Hut opening angle
+  Parameter cutoff{"/cutoff", "", 0.5, 0.1, 2.0}; // neighbors: pair range
+  ParameterMenu integrator{"/integrator"};
+  ParameterBool adaptive{"/adaptive", "", 0}; // substeps where it is stiff
   //
 
   ShaderProgram pointShader;
@@ -32,8 +50,11 @@ struct AlloApp : App
   Mesh mesh; // position *is inside the mesh* mesh.vertices() are the positions
  // Texture texBlur;
   vector<Vec3f> velocity;
-  vector<Vec3f> force;
+  vector<Vec3f> force; // kicks, applied at the next step
   vector<float> mass;
+  float minMass = 0;
+  HueCharges charges; // positions and hues for the charge force
+  ParticleStepper<Vec3f> stepper;
 
   HSV col;
 
@@ -48,6 +69,14 @@ struct AlloApp : App
     //
     gui.add(K);
     gui.add(Ke);
+    forceMode.setElements({"exact", "barnes-hut", "neighbors"});
+    forceMode.set(numParticles > 20000 ? BARNES_HUT : EXACT);
+    gui.add(forceMode);
+    gui.add(theta);
+    gui.add(cutoff);
+    integrator.setElements({"semi-implicit euler", "velocity verlet"});
+    gui.add(integrator);
+    gui.add(adaptive);
   }
 
   void onCreate() override
@@ -61,19 +90,21 @@ struct AlloApp : App
     //
 
     // c++11 "lambda" function
-    auto randomColor = []()
-    { return HSV(rnd::uniform(), 1.0f, 1.0f); };
+    auto randomColor = [](int i)
+    { return HSV(Philox(seed, 1).uniform(i, 0), 1.0f, 1.0f); };
     // HSV col = randomColor();
     mesh.primitive(Mesh::POINTS);
     // does 1000 work on your system? how many can you make before you get a low
     // frame rate? do you need to use <1000?
-    for (int _ = 0; _ < 1000; _++)
+    charges.resize(numParticles);
+    for (int i = 0; i < numParticles; i++)
     {
-      mesh.vertex(randomVec3f(5));
-      mesh.color(randomColor());
+      mesh.vertex(randomVec3f(i, 0, 0, 5));
+      mesh.color(randomColor(i));
+      charges.hue[i] = HSV(mesh.colors()[i]).h;
 
       // float m = rnd::uniform(3.0, 0.5);
-      float m = 3 + rnd::normal() / 2;
+      float m = 3 + Philox(seed, 2).normal(i, 0) / 2;
       if (m < 0.5)
         m = 0.5;
       mass.push_back(m);
@@ -82,9 +113,10 @@ struct AlloApp : App
       // mesh.texCoord(pow(m, 1.0f / 3), 0); // s, t
       mesh.texCoord(1.0, 0);
       //  separate state arrays
-      velocity.push_back(randomVec3f(0.1));
-      force.push_back(randomVec3f(1));
+      velocity.push_back(randomVec3f(i, 0, 1, 0.1));
+      force.push_back(randomVec3f(i, 0, 2, 1));
     }
+    minMass = *min_element(mass.begin(), mass.end());
     //texBlur.filter(Texture::LINEAR);
     nav().pos(0, 0, 10);
   }
@@ -115,56 +147,63 @@ struct AlloApp : App
     // • .dot(Vec3f f)
     // • .cross(Vec3f f)
 
-    // drag
+    // kicks are impulses: a step of F / m^2, as the Euler step gave them
     for (int i = 0; i < velocity.size(); i++)
     {
+      velocity[i] += force[i] / mass[i] / mass[i] * timeStep;
+      force[i].set(0);
+    }
 
-      Vec3f chgForce;
-      Vec3f tempPos = mesh.vertices()[i];
-      Vec3f springF = (tempPos.normalize() * 2 - mesh.vertices()[i]) * K;
-      for (int j = i + 1; j < velocity.size(); j++)
-      {
-        HSV q1 = mesh.colors()[i];
-        HSV q2 = mesh.colors()[j];
-        float charge = 1.0;
-        float asymCharge = (abs(sin((q2.h - q1.h) * M_PI))>.08)*2.0 - 1.0;
-
-        Vec3f dir = mesh.vertices()[j] - mesh.vertices()[i];
-        Vec3f dist = dir;
-        float eps0 = .001;
-        if(dist<.07){
-          asymCharge *= -1;
-        }
-        chgForce = (dir.normalize() * asymCharge) / (dist.magSqr() + .001);
-        chgForce *= eps0 * Ke;
-       
-
-        force[i] -= chgForce;
-        force[j] += chgForce;
-      }
-
-      force[i] += -velocity[i] * dragFactor + springF;
+    stepper.integrator =
+        integrator == VELOCITY_VERLET ? VELOCITY_VERLET : SEMI_IMPLICIT_EULER;
+    stepper.adaptive = adaptive;
+    // the spring's w is sqrt(K) / m, the drag's rate dragFactor / m^2
+    stepper.maxRate = max(dragFactor / minMass / minMass, sqrt(K) / minMass);
+    stepper.advance(mesh.vertices(), velocity, timeStep,
+                    [&](auto &x, auto &v, auto &a)
+                    { accelerations(x, v, a); });
+  }
 
-      force[i] /= mass[i];
+  // every particle's acceleration at positions x and velocities v
+  void accelerations(const vector<Vec3f> &x, const vector<Vec3f> &v,
+                     vector<Vec3f> &a)
+  {
+    // spring and drag
+    for (int i = 0; i < v.size(); i++)
+    {
+      Vec3f tempPos = x[i];
+      Vec3f springF = (tempPos.normalize() * 2 - x[i]) * K;
+      a[i] = -v[i] * dragFactor + springF;
     }
 
-    // Integration
-    //
-    vector<Vec3f> &position(mesh.vertices());
-    for (int i = 0; i < velocity.size(); i++)
+    // with Ke at 0 the charges do nothing, so skip them
+    if (Ke > 0)
     {
-      // "semi-implicit" Euler integration
-      velocity[i] += force[i] / mass[i] * timeStep;
-      position[i] += velocity[i] * timeStep;
-
-
+      for (int i = 0; i < v.size(); i++)
+      {
+        charges.x[i] = x[i].x;
+        charges.y[i] = x[i].y;
+        charges.z[i] = x[i].z;
+      }
+      charges.mode = ForceMode(forceMode.get());
+      charges.theta = theta;
+      charges.cutoff = cutoff;
+      charges.compute();
+      for (int i = 0; i < v.size(); i++)
+      {
+        a[i] += Vec3f(charges.fx[i], charges.fy[i], charges.fz[i]) *
+                (.001 * Ke); // eps0 * Ke
+      }
     }
 
-    // clear all accelerations (IMPORTANT!!)
-    for (auto &a : force)
-      a.set(0);
+    // F / m / m, as this sim has always had it
+    for (int i = 0; i < v.size(); i++)
+    {
+      a[i] /= mass[i] * mass[i];
+    }
   }
 
+  int kicks = 0; // '1' presses so far, the step of their random draws
   bool onKeyDown(const Keyboard &k) override
   {
     if (k.key() == ' ')
@@ -175,11 +214,13 @@ struct AlloApp : App
     if (k.key() == '1')
     {
       // introduce some "random" forces
+      kicks++;
       for (int i = 0; i < velocity.size(); i++)
       {
         // F = ma
-        force[i] += randomVec3f(2);
+        force[i] += randomVec3f(i, kicks, 0, 2);
       }
+      stepper.invalidate(); // the kick changes the drag
     }
 
     return true;
@@ -212,8 +253,13 @@ struct AlloApp : App
   }
 };
 
-int main()
+// usage: particle [numParticles]
+int main(int argc, char *argv[])
 {
+  if (argc > 1)
+  {
+    numParticles = max(1, atoi(argv[1]));
+  }
   AlloApp app;
   app.configureAudio(48000, 512, 2, 0);
   app.start();
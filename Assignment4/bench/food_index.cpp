@@ -0,0 +1,154 @@
+// Times nearest-food lookups in boids: a linear scan over every food
+// against DynamicGrid, with food eaten and respawned between queries, and
+// checks both pick the same food every time.
+//
+// build: g++ -O2 -std=c++17 food_index.cpp -o food_index
+// usage: ./food_index [foods] [prey] [steps] [cell size]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../../common/DynamicGrid.hpp"
+
+struct P
+{
+  float v[3];
+  float operator[](int c) const { return v[c]; }
+};
+
+// a point in the ball of radius 2, like rnd::ball<Vec3f>() * 2
+P ball(std::mt19937 &rng)
+{
+  std::uniform_real_distribution<float> uniformS(-1, 1);
+  P p;
+  do
+  {
+    for (float &c : p.v)
+    {
+      c = uniformS(rng);
+    }
+  } while (p[0] * p[0] + p[1] * p[1] + p[2] * p[2] > 1);
+  for (float &c : p.v)
+  {
+    c *= 2;
+  }
+  return p;
+}
+
+float dist2(const P &a, const P &b)
+{
+  float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// Each step every prey looks up its nearest food and eats it when within
+// `eatDist`, which respawns the food elsewhere. Returns the picks.
+template <class Nearest, class Respawn>
+std::vector<int> run(const std::vector<P> &prey, int steps, Nearest nearest,
+                     Respawn respawn, double &ms)
+{
+  const float eatDist = 0.05f;
+  std::vector<int> picks;
+  picks.reserve(prey.size() * steps);
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; s++)
+  {
+    for (int i = 0; i < (int)prey.size(); i++)
+    {
+      // prey drift a little each step
+      P p = prey[i];
+      p.v[0] += 0.01f * s;
+      float d;
+      int j = nearest(p, d);
+      picks.push_back(j);
+      if (d < eatDist)
+      {
+        respawn(j);
+      }
+    }
+  }
+  ms = std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start)
+           .count() /
+       steps;
+  return picks;
+}
+
+int main(int argc, char *argv[])
+{
+  int numFood = argc > 1 ? atoi(argv[1]) : 5000;
+  int numPrey = argc > 2 ? atoi(argv[2]) : 20000;
+  int steps = argc > 3 ? atoi(argv[3]) : 10;
+
+  std::mt19937 rng(1);
+  std::vector<P> prey(numPrey), initial(numFood);
+  for (P &p : prey)
+  {
+    p = ball(rng);
+  }
+  for (P &f : initial)
+  {
+    f = ball(rng);
+  }
+
+  // linear scan, as boids did
+  std::vector<P> foods = initial;
+  std::mt19937 rngScan(2);
+  auto scanNearest = [&](const P &p, float &d)
+  {
+    int best = 0;
+    float bestD2 = dist2(foods[0], p);
+    for (int j = 1; j < numFood; j++)
+    {
+      float d2 = dist2(foods[j], p);
+      if (d2 < bestD2)
+      {
+        bestD2 = d2;
+        best = j;
+      }
+    }
+    d = std::sqrt(bestD2);
+    return best;
+  };
+  auto scanRespawn = [&](int j)
+  { foods[j] = ball(rngScan); };
+  double tScan;
+  std::vector<int> scanPicks =
+      run(prey, steps, scanNearest, scanRespawn, tScan);
+
+  std::vector<P> gridFoods = initial;
+  std::mt19937 rngGrid(2);
+  DynamicGrid grid;
+  // cells as in boids, or as given
+  float cellSize = argc > 4 ? atof(argv[4]) : 2 / std::cbrt(numFood / 5.0f);
+  grid.configure(3, cellSize);
+  for (int j = 0; j < numFood; j++)
+  {
+    grid.insert(j, gridFoods[j][0], gridFoods[j][1], gridFoods[j][2]);
+  }
+  auto gridNearest = [&](const P &p, float &d)
+  { return grid.nearest(p, INFINITY, &d); };
+  auto gridRespawn = [&](int j)
+  {
+    gridFoods[j] = ball(rngGrid);
+    grid.move(j, gridFoods[j][0], gridFoods[j][1], gridFoods[j][2]);
+  };
+  double tGrid;
+  std::vector<int> gridPicks =
+      run(prey, steps, gridNearest, gridRespawn, tGrid);
+
+  int mismatches = 0;
+  for (size_t k = 0; k < scanPicks.size(); k++)
+  {
+    mismatches += scanPicks[k] != gridPicks[k];
+  }
+  printf("%d foods, %d prey, ms per step\n", numFood, numPrey);
+  printf("  %-6s %9.3f\n", "scan", tScan);
+  printf("  %-6s %9.3f  (%.1fx)\n", "grid", tGrid, tScan / tGrid);
+  printf("picks differing: %d of %zu\n", mismatches, scanPicks.size());
+  return mismatches > 0;
+}
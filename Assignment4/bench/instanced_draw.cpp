@@ -0,0 +1,258 @@
+// Draws boids-like cones headlessly, once with one draw call per object and
+// once with InstancedMesh, checks both give the same picture and times
+// them.
+//
+// Needs no window: it asks EGL for a surfaceless context, which Mesa's
+// software rasterizer (llvmpipe) provides, and renders into a framebuffer
+// object. The shaders are the ones boids uses.
+//
+// build: g++ -O2 -std=c++17 instanced_draw.cpp -o instanced_draw -lEGL -lGL
+// usage: ./instanced_draw [objects] [frames]   (run from this directory)
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../common/InstancedMesh.hpp"
+
+const int width = 512, height = 512;
+
+// the parts of al::Mesh that InstancedMesh::setMesh reads
+struct ConeMesh
+{
+  std::vector<std::array<float, 3>> v, n;
+  std::vector<unsigned int> i;
+  const std::vector<std::array<float, 3>> &vertices() const { return v; }
+  const std::vector<std::array<float, 3>> &normals() const { return n; }
+  const std::vector<unsigned int> &indices() const { return i; }
+  int primitive() const { return GL_TRIANGLES; }
+};
+
+// like al::addCone: apex at z = 1, base circle of radius 1 at z = 0
+ConeMesh cone(int slices)
+{
+  ConeMesh m;
+  m.v.push_back({0, 0, 1});
+  m.n.push_back({0, 0, 1});
+  for (int k = 0; k < slices; k++)
+  {
+    float a = 2 * (float)M_PI * k / slices;
+    float c = std::cos(a), s = std::sin(a);
+    m.v.push_back({c, s, 0});
+    m.n.push_back({c * 0.7071f, s * 0.7071f, 0.7071f});
+    m.i.insert(m.i.end(), {0u, 1u + k, 1u + (k + 1) % slices});
+  }
+  return m;
+}
+
+std::string slurp(const char *fileName)
+{
+  std::ifstream file(fileName);
+  std::stringstream s;
+  s << file.rdbuf();
+  return s.str();
+}
+
+GLuint compileShader()
+{
+  GLuint program = glCreateProgram();
+  const char *files[] = {"../instanced-vertex.glsl",
+                         "../instanced-fragment.glsl"};
+  GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  for (int k = 0; k < 2; k++)
+  {
+    std::string source = slurp(files[k]);
+    const char *text = source.c_str();
+    GLuint shader = glCreateShader(types[k]);
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+    GLint ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+      char log[1024];
+      glGetShaderInfoLog(shader, sizeof log, nullptr, log);
+      printf("%s: %s\n", files[k], log);
+      exit(1);
+    }
+    glAttachShader(program, shader);
+  }
+  glLinkProgram(program);
+  glUseProgram(program);
+  // column major; view the box [-2.5, 2.5]^3 head on
+  float s = 1 / 2.5f;
+  float modelView[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+  float projection[16] = {s, 0, 0, 0, 0, s, 0, 0, 0, 0, -s, 0, 0, 0, 0, 1};
+  glUniformMatrix4fv(glGetUniformLocation(program, "al_ModelViewMatrix"), 1,
+                     GL_FALSE, modelView);
+  glUniformMatrix4fv(glGetUniformLocation(program, "al_ProjectionMatrix"), 1,
+                     GL_FALSE, projection);
+  return program;
+}
+
+bool makeContext()
+{
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+      "eglGetPlatformDisplayEXT");
+  EGLDisplay display =
+      getPlatformDisplay
+          ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                               EGL_DEFAULT_DISPLAY, nullptr)
+          : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (!eglInitialize(display, nullptr, nullptr))
+  {
+    return false;
+  }
+  eglBindAPI(EGL_OPENGL_API);
+  const EGLint attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 4,
+                               EGL_CONTEXT_MINOR_VERSION, 1,
+                               EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                               EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR,
+                                        EGL_NO_CONTEXT, attributes);
+  return context &&
+         eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+void makeFramebuffer()
+{
+  GLuint fbo, color, depth;
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  glViewport(0, 0, width, height);
+  glEnable(GL_DEPTH_TEST);
+}
+
+// random poses in the boids' box, random colours
+std::vector<Instance> scatter(int n)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniformS(-1, 1), uniform(0, 1);
+  std::vector<Instance> instances(n);
+  for (Instance &inst : instances)
+  {
+    float q[4], m = 0;
+    for (float &c : q)
+    {
+      c = uniformS(rng);
+      m += c * c;
+    }
+    m = std::sqrt(m);
+    for (int c = 0; c < 4; c++)
+    {
+      inst.quat[c] = q[c] / m;
+      inst.color[c] = c < 3 ? uniform(rng) : 1;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+      inst.position[c] = 2 * uniformS(rng);
+    }
+    inst.scale[0] = inst.scale[1] = 0.03f;
+    inst.scale[2] = 0.07f;
+  }
+  return instances;
+}
+
+std::vector<unsigned char> readPixels()
+{
+  std::vector<unsigned char> pixels(4 * width * height);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+template <class F>
+double msPerFrame(int frames, F &&f)
+{
+  glFinish();
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < frames; k++)
+  {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    f();
+  }
+  glFinish();
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         frames;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 5000;
+  int frames = argc > 2 ? atoi(argv[2]) : 20;
+  if (!makeContext())
+  {
+    printf("no EGL context (eglGetError %x)\n", eglGetError());
+    return 1;
+  }
+  printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+  makeFramebuffer();
+  compileShader();
+
+  InstancedMesh mesh;
+  mesh.setMesh(cone(16));
+  std::vector<Instance> all = scatter(n);
+
+  // one object per draw call, as boids did with pushMatrix / draw(mesh)
+  double tEach = msPerFrame(frames, [&]
+                            {
+    for (const Instance &inst : all)
+    {
+      mesh.instances.assign(1, inst);
+      mesh.draw();
+    } });
+  std::vector<unsigned char> each = readPixels();
+
+  double tInstanced = msPerFrame(frames, [&]
+                                 {
+    mesh.instances = all;
+    mesh.draw(); });
+  std::vector<unsigned char> instanced = readPixels();
+
+  int covered = 0, differ = 0;
+  for (int p = 0; p < width * height; p++)
+  {
+    bool drawn = false, same = true;
+    for (int c = 0; c < 3; c++)
+    {
+      drawn |= instanced[4 * p + c] != 0;
+      same &= instanced[4 * p + c] == each[4 * p + c];
+    }
+    covered += drawn;
+    differ += !same;
+  }
+
+  printf("%d cones, %dx%d, ms per frame\n", n, width, height);
+  printf("  %-10s %8.3f  (%d draw calls)\n", "per object", tEach, n);
+  printf("  %-10s %8.3f  (1 draw call, %.1fx)\n", "instanced", tInstanced,
+         tEach / tInstanced);
+  printf("pixels covered %d, differing between the two %d\n", covered, differ);
+  GLenum error = glGetError();
+  if (error != GL_NO_ERROR || covered == 0 || differ > 0)
+  {
+    printf("FAILED (glGetError %x)\n", error);
+    return 1;
+  }
+  return 0;
+}
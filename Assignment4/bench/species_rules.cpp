@@ -0,0 +1,271 @@
+// Times one boids step written out by hand, as boids.cpp had it, against
+// the same rules run through SpeciesRules.hpp's kernels, and checks both
+// leave every agent in the same pose.
+//
+// Food seeking is left out; the other rules are boids' with its default
+// parameters. Build with -ffp-contract=off for the poses to match bit for
+// bit: otherwise the compiler fuses multiply-adds differently in the two
+// versions and they drift apart by rounding.
+//
+// build: g++ -O2 -march=native -ffp-contract=off -std=c++17
+//          species_rules.cpp -o species_rules
+// usage: ./species_rules [prey] [predators] [steps]
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../../common/SpeciesRules.hpp"
+
+const float gridExtent = 3;
+const float cohesion = 0.02f, minDist = 0.2f, aversion = 0.12f,
+            preyAwareness = 0.12f, predAversion = 0.22f,
+            predAppetite = 0.22f, predAwareness = 0.22f;
+const float moveRate = 0.02f;
+
+struct World
+{
+  PoseBatch preds, preys;
+  SpatialGrid preyGrid, predGrid;
+};
+
+World scatter(int numPrey, int numPred)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniformS(-1, 1);
+  World w;
+  for (PoseBatch *p : {&w.preds, &w.preys})
+  {
+    p->resize(p == &w.preds ? numPred : numPrey);
+    for (int i = 0; i < p->size(); i++)
+    {
+      p->setPosition(i, uniformS(rng), uniformS(rng), uniformS(rng));
+      p->faceToward(i, 10 * uniformS(rng), 10 * uniformS(rng),
+                    10 * uniformS(rng), 1);
+    }
+  }
+  return w;
+}
+
+void buildGrids(World &w, float preyReach, float predReach)
+{
+  auto preyPos = [&](int k)
+  { return w.preys.position(k); };
+  auto predPos = [&](int k)
+  { return w.preds.position(k); };
+  w.preyGrid.configure(gridExtent, preyReach);
+  w.preyGrid.build(w.preys.size(), preyPos);
+  w.predGrid.configure(gridExtent, predReach);
+  w.predGrid.build(w.preds.size(), predPos);
+}
+
+// boids.cpp's loops before the kernels, with std::array for Vec3f
+struct Handwritten
+{
+  std::vector<float> tx, ty, tz, amt;
+  std::vector<int> near;
+
+  void aim(int i, float x, float y, float z, float a)
+  {
+    tx[i] = x;
+    ty[i] = y;
+    tz[i] = z;
+    amt[i] = a;
+  }
+
+  void turnAll(PoseBatch &p)
+  {
+    p.faceToward(tx.data(), ty.data(), tz.data(), amt.data(), 0, p.size());
+  }
+
+  static float mag(const std::array<float, 3> &v)
+  {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  }
+
+  void step(World &w)
+  {
+    PoseBatch &preds = w.preds, &preys = w.preys;
+    int numPred = preds.size(), numPrey = preys.size();
+    for (auto *a : {&tx, &ty, &tz, &amt})
+    {
+      a->resize(std::max(numPred, numPrey));
+    }
+
+    for (int i = 0; i < numPred; i++)
+    {
+      aim(i, 0, 0, 0, mag(preds.position(i)) > 2 ? .015f : 0);
+    }
+    turnAll(preds);
+    preds.moveF(moveRate / 2, 0, numPred);
+    preds.step();
+
+    float dir[3] = {0, 0, 0};
+    for (int i = 0; i < numPrey; i++)
+    {
+      auto f = preys.uf(i);
+      for (int c = 0; c < 3; c++)
+      {
+        dir[c] += f[c] / numPrey;
+      }
+      aim(i, 0, 0, 0, mag(preys.position(i)) > 2 ? .015f : 0);
+    }
+    turnAll(preys);
+    for (int i = 0; i < numPrey; i++)
+    {
+      aim(i, dir[0], dir[1], dir[2], cohesion);
+    }
+    turnAll(preys);
+
+    float predReach = std::max(preyAwareness, predAwareness);
+    buildGrids(w, minDist, predReach);
+    auto toward = [](PoseBatch &p, int i, const std::array<float, 3> &pos,
+                     float sign, const float *dif, float a)
+    {
+      auto f = p.uf(i);
+      p.faceToward(i, pos[0] + f[0] + sign * dif[0],
+                   pos[1] + f[1] + sign * dif[1],
+                   pos[2] + f[2] + sign * dif[2], a);
+    };
+    for (int i = 0; i < numPrey; i++)
+    {
+      auto pos = preys.position(i);
+
+      near.clear();
+      auto laterPrey = [&](int k)
+      {
+        if (k > i)
+        {
+          near.push_back(k);
+        }
+      };
+      w.preyGrid.forEachCandidate(pos, minDist, laterPrey);
+      std::sort(near.begin(), near.end());
+      for (int k : near)
+      {
+        auto qPos = preys.position(k);
+        float dif[3] = {qPos[0] - pos[0], qPos[1] - pos[1], qPos[2] - pos[2]};
+        float d = mag({dif[0], dif[1], dif[2]});
+        if (d < minDist)
+        {
+          toward(preys, i, pos, -1, dif, aversion);
+          toward(preys, k, qPos, 1, dif, aversion);
+        }
+      }
+
+      near.clear();
+      auto anyPred = [&](int l)
+      { near.push_back(l); };
+      w.predGrid.forEachCandidate(pos, predReach, anyPred);
+      std::sort(near.begin(), near.end());
+      for (int l : near)
+      {
+        auto sPos = preds.position(l);
+        float dif[3] = {sPos[0] - pos[0], sPos[1] - pos[1], sPos[2] - pos[2]};
+        float d = mag({dif[0], dif[1], dif[2]});
+        if (d < preyAwareness)
+        {
+          toward(preys, i, pos, -1, dif, predAversion);
+          toward(preds, l, sPos, -1, dif, predAppetite);
+        }
+        if (d < predAwareness)
+        {
+          toward(preds, l, sPos, -1, dif, predAppetite * .5f);
+        }
+      }
+    }
+    preys.moveF(moveRate, 0, numPrey);
+    preys.step();
+  }
+};
+
+// the same step through the kernels, as boids.cpp runs it now
+struct Kernels
+{
+  SelfKernel<ReturnHome> predRules;
+  SelfKernel<ReturnHome, Cohesion> preyRules;
+  PairKernel<Avoid<SIDE_A>, Avoid<SIDE_B>> preyPreyRules;
+  PairKernel<Avoid<SIDE_A>, Approach<SIDE_B>, Approach<SIDE_B>>
+      preyPredRules;
+
+  Kernels()
+  {
+    predRules.rule<0>().amount = .015f;
+    preyRules.rule<0>().amount = .015f;
+    preyRules.rule<1>().amount = cohesion;
+    preyPreyRules.rules = {{minDist, aversion}, {minDist, aversion}};
+    preyPredRules.rules = {{preyAwareness, predAversion},
+                           {preyAwareness, predAppetite},
+                           {predAwareness, predAppetite * .5f}};
+  }
+
+  void step(World &w)
+  {
+    predRules.run(w.preds);
+    w.preds.moveF(moveRate / 2, 0, w.preds.size());
+    w.preds.step();
+    preyRules.run(w.preys);
+    buildGrids(w, preyPreyRules.reach(), preyPredRules.reach());
+    for (int i = 0; i < w.preys.size(); i++)
+    {
+      preyPreyRules.run(w.preys, i, w.preys, w.preyGrid);
+      preyPredRules.run(w.preys, i, w.preds, w.predGrid);
+    }
+    w.preys.moveF(moveRate, 0, w.preys.size());
+    w.preys.step();
+  }
+};
+
+template <class F>
+double msPerStep(int steps, F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; s++)
+  {
+    f();
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         steps;
+}
+
+int main(int argc, char *argv[])
+{
+  int numPrey = argc > 1 ? atoi(argv[1]) : 10000;
+  int numPred = argc > 2 ? atoi(argv[2]) : 100;
+  int steps = argc > 3 ? atoi(argv[3]) : 10;
+
+  World a = scatter(numPrey, numPred), b = a;
+  Handwritten handwritten;
+  Kernels kernels;
+  double tHand = msPerStep(steps, [&]
+                           { handwritten.step(a); });
+  double tKernel = msPerStep(steps, [&]
+                             { kernels.step(b); });
+
+  int differ = 0;
+  for (auto group : {&PoseBatch::x, &PoseBatch::y, &PoseBatch::z,
+                     &PoseBatch::qw, &PoseBatch::qx, &PoseBatch::qy,
+                     &PoseBatch::qz})
+  {
+    for (auto world : {std::make_pair(&a.preys, &b.preys),
+                       std::make_pair(&a.preds, &b.preds)})
+    {
+      const auto &u = world.first->*group, &v = world.second->*group;
+      differ += std::memcmp(u.data(), v.data(), u.size() * sizeof(float)) != 0;
+    }
+  }
+
+  printf("%d prey, %d predators, ms per step\n", numPrey, numPred);
+  printf("  %-12s %8.2f\n", "handwritten", tHand);
+  printf("  %-12s %8.2f  (%.2fx)\n", "kernels", tKernel, tHand / tKernel);
+  printf("after %d steps the poses %s\n", steps,
+         differ ? "differ" : "are identical");
+  return 0;
+}
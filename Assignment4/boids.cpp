@@ -1,24 +1,60 @@
 // how to include things ~ how do we know what to include?
 // fewer includes == faster compile == only include what you need
 #include "al/app/al_App.hpp"
-#include "al/math/al_Random.hpp"
 #include "al/graphics/al_Shapes.hpp" // addCone
 #include "al/app/al_GUIDomain.hpp"
 
 #include <fstream>
+#include <random>
 #include <vector>
 
+#include "../common/DynamicGrid.hpp"
+#include "../common/InstancedMesh.hpp"
+#include "../common/Philox.hpp"
+#include "../common/PoseBatch.hpp"
+#include "../common/SpatialGrid.hpp"
+#include "../common/SpeciesRules.hpp"
+
 using namespace al;
 using namespace std;
 
-Vec3f randomVec3f(float scale)
+string slurp(string fileName);
+
+// A point in the cube of half-width `scale`: agent i's `draw`th from
+// `rng`, the same every run with the same seed.
+Vec3f randomVec3f(const Philox &rng, int i, int draw, float scale)
+{
+    auto v = rng.uniformS3(i, 0, draw);
+    return Vec3f(v[0], v[1], v[2]) * scale;
+}
+
+// PoseBatch accessors in allolib types
+Vec3f position(const PoseBatch &p, int i)
+{
+    auto v = p.position(i);
+    return Vec3f(v[0], v[1], v[2]);
+}
+
+Vec3f uf(const PoseBatch &p, int i)
+{
+    auto v = p.uf(i);
+    return Vec3f(v[0], v[1], v[2]);
+}
+
+void faceToward(PoseBatch &p, int i, const Vec3f &target, float amt = 1)
 {
-    return Vec3f(rnd::uniformS(), rnd::uniformS(), rnd::uniformS()) * scale;
+    p.faceToward(i, target.x, target.y, target.z, amt);
 }
 
-const int numPred = 4;
-const int numPrey = 100;
-const int numFood = 5;
+// set from the command line
+int numPred = 4;
+int numPrey = 100;
+int numFood = 5;
+uint64_t seed = random_device()();
+
+// Agents are pulled back once they pass radius 2; the grids cover this box
+// and clamp any stragglers into the border cells.
+const float gridExtent = 3;
 
 bool follow = false;
 bool followPred = false;
@@ -35,12 +71,53 @@ struct MyApp : public App
     Parameter predAppetite{"/predAppetite", "", 0.22, 0.002, .5};
     Parameter predAwareness{"/predAwareness", "", 0.22, 0.02, 1.0};
 
-    Mesh predMesh;
-    Mesh preyMesh;
-    Mesh foodMesh;
+    // one instanced draw call per species
+    InstancedMesh predMesh;
+    InstancedMesh preyMesh;
+    InstancedMesh foodMesh;
+    ShaderProgram instancedShader;
+
+    PoseBatch preds, preys;
+    vector<Vec3f> foods;
+    // foods by position; eating or respawning one updates just that one
+    DynamicGrid foodGrid;
+    vector<uint64_t> foodSpawns;
+    Philox foodRng{seed, 3};
+
+    // rebuilt every step, for the pair rules
+    SpatialGrid preyGrid, predGrid;
+
+    // Turns toward the nearest food and eats it once close enough, which
+    // respawns it elsewhere for the prey after this one.
+    struct SeekFood : SelfRule
+    {
+        MyApp *app = nullptr;
+        float amount = 0;
+
+        void aim(const PoseBatch &p, int i, float &tx, float &ty, float &tz,
+                 float &amt) const
+        {
+            float dist;
+            int dex = app->foodGrid.nearest(p.position(i), INFINITY, &dist);
+            Vec3f food = app->foods[dex];
+            tx = food.x;
+            ty = food.y;
+            tz = food.z;
+            amt = amount;
+            if (dist < .02)
+            {
+                app->respawnFood(dex);
+            }
+        }
+    };
 
-    Nav preds[numPred], preys[numPrey];
-    Vec3f foods[numFood];
+    // The rules of each species, and of each pair of species. Each kernel
+    // is compiled for its own list of rules; see SpeciesRules.hpp.
+    SelfKernel<ReturnHome> predRules;
+    SelfKernel<ReturnHome, Cohesion, SeekFood> preyRules;
+    PairKernel<Avoid<SIDE_A>, Avoid<SIDE_B>> preyPreyRules;
+    PairKernel<Avoid<SIDE_A>, Approach<SIDE_B>, Approach<SIDE_B>>
+        preyPredRules;
 
     void onInit() override
     {
@@ -59,30 +136,56 @@ struct MyApp : public App
 
     void onCreate()
     {
-        addCone(predMesh);
-        predMesh.generateNormals();
-        addCone(preyMesh);
-        preyMesh.generateNormals();
-        addSphere(foodMesh);
-        foodMesh.generateNormals();
+        Mesh cone, sphere;
+        addCone(cone);
+        cone.generateNormals();
+        addSphere(sphere);
+        sphere.generateNormals();
+        predMesh.setMesh(cone);
+        preyMesh.setMesh(cone);
+        foodMesh.setMesh(sphere);
+        instancedShader.compile(slurp("../instanced-vertex.glsl"),
+                                slurp("../instanced-fragment.glsl"));
+
+        preds.resize(numPred);
+        preys.resize(numPrey);
+        preyRules.rule<2>().app = this;
+        foods.resize(numFood);
+        foodSpawns.assign(numFood, 0);
+        // about one food per cell across the ball they spawn in
+        foodGrid.configure(gridExtent, 2 / cbrt(numFood / 5.0f));
+        for (int j = 0; j < numFood; j++)
+        {
+            respawnFood(j);
+        }
 
+        Philox predStart(seed, 1), preyStart(seed, 2);
         for (int i = 0; i < numPred; i++)
         {
-            Vec3f pos = randomVec3f(1);
-            preds[i].pos() = pos;
-            preds[i].faceToward(randomVec3f(10));
+            Vec3f pos = randomVec3f(predStart, i, 0, 1);
+            preds.setPosition(i, pos.x, pos.y, pos.z);
+            faceToward(preds, i, randomVec3f(predStart, i, 1, 10));
         }
         for (int i = 0; i < numPrey; i++)
         {
-            Vec3f pos = randomVec3f(1);
-            preys[i].pos() = pos;
-            preys[i].faceToward(randomVec3f(10));
+            Vec3f pos = randomVec3f(preyStart, i, 0, 1);
+            preys.setPosition(i, pos.x, pos.y, pos.z);
+            faceToward(preys, i, randomVec3f(preyStart, i, 1, 10));
         }
 
         nav().pos(0, 0, 7);
         nav().faceToward(Vec3f(0, 0, 0), 1.0);
     }
 
+    void respawnFood(int j)
+    {
+        // keyed by (food, how often it has respawned), so the result does
+        // not depend on the order foods are eaten in
+        auto p = foodRng.ball(j, foodSpawns[j]++);
+        foods[j] = Vec3f(p[0], p[1], p[2]) * 2;
+        foodGrid.move(j, foods[j].x, foods[j].y, foods[j].z);
+    }
+
     double phase = 0;
     void onAnimate(double dt)
     {
@@ -91,98 +194,62 @@ struct MyApp : public App
         if (phase >= 3)
         {
             phase -= 3;
-            for (int i = 0; i < numFood; i++)
+            for (int j = 0; j < numFood; j++)
             {
-                foods[i] = rnd::ball<Vec3f>() * 2;
+                respawnFood(j);
             }
         }
 
         double turn_rate = 0.05;
         double move_rate = 0.02;
 
-        for (int i = 0; i < numPred; i++)
-        {
-            Nav &pr = preds[i];
-            if (pr.pos().mag() > 2)
-            {
-                pr.faceToward(Vec3f(0, 0, 0), .015);
-            }
-            pr.moveF(move_rate / 2);
-            pr.step();
-        }
-
-        Vec3f preyDir;
+        // this frame's parameter values
+        predRules.rule<0>().amount = .015;
+        preyRules.rule<0>().amount = .015;
+        preyRules.rule<1>().amount = cohesion;
+        preyRules.rule<2>().amount = appetite;
+        preyPreyRules.rules = {{minDist, aversion}, {minDist, aversion}};
+        preyPredRules.rules = {{preyAwareness, predAversion},
+                               {preyAwareness, predAppetite},
+                               {predAwareness, predAppetite * .5f}};
+
+        predRules.run(preds);
+        preds.moveF(move_rate / 2, 0, numPred);
+        preds.step();
+
+        preyRules.run(preys);
+
+        // The pair rules look agents up in grids instead of scanning every
+        // pair. Positions don't change until the step below, so grids
+        // built now stay valid for the whole loop.
+        auto preyPos = [&](int k)
+        { return preys.position(k); };
+        auto predPos = [&](int k)
+        { return preds.position(k); };
+        preyGrid.configure(gridExtent, preyPreyRules.reach());
+        preyGrid.build(numPrey, preyPos);
+        predGrid.configure(gridExtent, preyPredRules.reach());
+        predGrid.build(numPred, predPos);
+
+        // every pair kernel for prey i before prey i + 1, as the
+        // handwritten loops did
         for (int i = 0; i < numPrey; i++)
         {
-            Nav &p = preys[i];
-            preyDir += p.uf()/numPrey;
-            if (p.pos().mag() > 2)
-            {
-                p.faceToward(Vec3f(0, 0, 0), .015);
-            }
+            preyPreyRules.run(preys, i, preys, preyGrid);
+            preyPredRules.run(preys, i, preds, predGrid);
         }
 
-        for (int i = 0; i < numPrey; i++)
-        {
-            Nav &p = preys[i];
-            p.faceToward(preyDir, cohesion);
-            float dist = 100000;
-            int dex = 0;
-            for (int j = 0; j < numFood; j++)
-            {
-                float tDist = (foods[j] - p.pos()).mag();
-                dist = tDist < dist ? tDist : dist;
-                dex = tDist < dist ? i : dex;
-            }
-            p.faceToward(foods[dex], appetite);
-
-            if (dist < .02)
-            {
-                foods[dex] = rnd::ball<Vec3f>() * 2;
-            }
-
-            for (int k = i + 1; k < numPrey; k++)
-            {
-                Nav &q = preys[k];
-                Vec3f dif = (q.pos() - p.pos());
-                float d = dif.mag();
-                if (d < minDist)
-                {
-
-                    p.faceToward(p.pos() + p.uf() - dif, aversion);
-                    q.faceToward(q.pos() + q.uf() + dif, aversion);
-                }
-            }
-            for (int l = i + 1; l < numPred; l++)
-            {
-                Nav &s = preds[l];
-                Vec3f dif = (s.pos() - p.pos());
-                float d = dif.mag();
-                if (d < preyAwareness)
-                {
-
-                    p.faceToward(p.pos() + p.uf() - dif, predAversion);
-                    s.faceToward(s.pos() + s.uf() - dif, predAppetite);
-                }
-                if (d < predAwareness)
-                {
-
-                    s.faceToward(s.pos() + s.uf() - dif, predAppetite * .5);
-                }
-            }
-
-            p.moveF(move_rate);
-            p.step();
-        }
+        preys.moveF(move_rate, 0, numPrey);
+        preys.step();
         if (follow == true)
         {
-            nav().pos(preys[0].pos() - preys[0].uf() * 2);
-            nav().faceToward(preys[0].pos(), 1.0);
+            nav().pos(Vec3d(position(preys, 0) - uf(preys, 0) * 2));
+            nav().faceToward(Vec3d(position(preys, 0)), 1.0);
         }
         if (followPred == true)
         {
-            nav().pos(preds[0].pos() - preds[0].uf() * 3);
-            nav().faceToward(preds[0].pos(), 1.0);
+            nav().pos(Vec3d(position(preds, 0) - uf(preds, 0) * 3));
+            nav().faceToward(Vec3d(position(preds, 0)), 1.0);
         }
     }
 
@@ -214,51 +281,92 @@ struct MyApp : public App
         return true;
     }
 
+    // the instance buffer of `mesh` from the poses of `group`
+    void setInstances(InstancedMesh &mesh, const PoseBatch &group,
+                      const Vec3f &scale, const Color &color)
+    {
+        mesh.instances.resize(group.size());
+        for (int i = 0; i < group.size(); i++)
+        {
+            Instance &inst = mesh.instances[i];
+            auto p = group.position(i);
+            auto q = group.quat(i);
+            for (int c = 0; c < 3; c++)
+            {
+                inst.position[c] = p[c];
+                inst.scale[c] = scale[c];
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                inst.quat[c] = q[c];
+            }
+            inst.color[0] = color.r;
+            inst.color[1] = color.g;
+            inst.color[2] = color.b;
+            inst.color[3] = color.a;
+        }
+    }
+
     void onDraw(Graphics &g)
     {
         g.depthTesting(true);
-        g.lighting(true);
         g.clear(0);
 
-        g.color(1, 0, 0);
-        for (int i = 0; i < numPred; i++)
+        setInstances(predMesh, preds, Vec3f(0.05, .05, .15), Color(1, 0, 0));
+        setInstances(preyMesh, preys, Vec3f(0.03, .03, .07), Color(1, 0, 1));
+        foodMesh.instances.resize(numFood);
+        for (int i = 0; i < numFood; i++)
         {
-            g.pushMatrix();
-            g.translate(preds[i].pos());
-            g.rotate(preds[i].quat());
-            g.scale(Vec3f(0.05, .05, .15));
-            g.draw(predMesh);
-            g.popMatrix();
-        }
-        g.color(1, 0, 1);
-        for (int i = 0; i < numPrey; i++)
-        {
-            g.pushMatrix();
-            g.translate(preys[i].pos());
-            g.rotate(preys[i].quat());
-            g.scale(Vec3f(0.03, .03, .07));
-            g.draw(preyMesh);
-            g.popMatrix();
+            Instance &inst = foodMesh.instances[i];
+            inst = Instance{{foods[i].x, foods[i].y, foods[i].z},
+                            {0.03, 0.03, 0.03},
+                            {1, 0, 0, 0},
+                            {0, 0, 1, 1}};
         }
 
-        g.color(0, 0, 1);
-        for (int i = 0; i < numPrey; i++)
-        {
-            g.pushMatrix();
-            g.translate(foods[i]);
-            // g.rotate(foods[i].quat());
-            g.scale(0.03);
-            g.draw(foodMesh);
-            g.popMatrix();
-        }
+        g.shader(instancedShader);
+        g.update();
+        predMesh.draw();
+        preyMesh.draw();
+        foodMesh.draw();
     }
 };
 
-int main()
+// usage: boids [numPrey] [numPred] [numFood] [seed]
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+    {
+        numPrey = max(1, atoi(argv[1]));
+    }
+    if (argc > 2)
+    {
+        numPred = max(1, atoi(argv[2]));
+    }
+    if (argc > 3)
+    {
+        numFood = max(1, atoi(argv[3]));
+    }
+    if (argc > 4)
+    {
+        seed = strtoull(argv[4], nullptr, 10);
+    }
     MyApp app;
     app.configureAudio(48000, 512, 2, 0);
     app.start();
 }
 
 // int main() {  MyApp().start(); }
+
+string slurp(string fileName)
+{
+    fstream file(fileName);
+    string returnValue = "";
+    while (file.good())
+    {
+        string line;
+        getline(file, line);
+        returnValue += line + "\n";
+    }
+    return returnValue;
+}
@@ -0,0 +1,13 @@
+#version 400
+
+in vec4 color;
+in vec3 normal;
+
+layout(location = 0) out vec4 fragmentColor;
+
+void main() {
+  // a light over the viewer's shoulder, plus some ambient
+  vec3 light = normalize(vec3(0.3, 0.5, 1.0));
+  float diffuse = max(dot(normalize(normal), light), 0.0);
+  fragmentColor = vec4(color.rgb * (0.3 + 0.7 * diffuse), color.a);
+}
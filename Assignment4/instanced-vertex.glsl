@@ -0,0 +1,33 @@
+#version 400
+
+// One copy of the mesh per Instance (common/InstancedMesh.hpp): the mesh
+// vertex is scaled, rotated and moved by the instance's pose, like
+// translate / rotate / scale did per object.
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec3 instancePosition;
+layout(location = 3) in vec3 instanceScale;
+layout(location = 4) in vec4 instanceQuat; // (w, x, y, z)
+layout(location = 5) in vec4 instanceColor;
+
+uniform mat4 al_ModelViewMatrix;
+uniform mat4 al_ProjectionMatrix;
+
+out vec4 color;
+out vec3 normal;
+
+// rotate v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v) {
+  vec3 u = q.yzw;
+  return v + 2.0 * cross(u, cross(u, v) + q.x * v);
+}
+
+void main() {
+  vec3 p = rotate(instanceQuat, vertexPosition * instanceScale);
+  gl_Position = al_ProjectionMatrix * al_ModelViewMatrix *
+                vec4(p + instancePosition, 1.0);
+  // normals scale by the inverse
+  vec3 n = rotate(instanceQuat, vertexNormal / instanceScale);
+  normal = mat3(al_ModelViewMatrix) * n;
+  color = instanceColor;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// std::vector storage aligned to cache lines, so SoA arrays start on a
+// 64 byte boundary and the compiler can use aligned vector loads.
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+template <class T, std::size_t Alignment = 64>
+struct AlignedAllocator
+{
+  using value_type = T;
+
+  template <class U>
+  struct rebind
+  {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(std::size_t n)
+  {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, std::size_t)
+  {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+template <class T>
+using aligned_vector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,223 @@
+#pragma once
+
+// Amplitude panning for many sources at once.
+//
+// Every speaker within `spread` of a source's direction gets a gain that
+// falls off linearly in cosine toward the edge of the spread; the gains are
+// then normalized for constant power. All sources that moved are updated
+// in one pass over SoA speaker arrays (SIMD over speakers). Sources that
+// turned less than cacheAngle since their gains were computed keep them.
+// Gains ramp across each block, and only speakers with a nonzero gain are
+// mixed.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "AlignedAllocator.hpp"
+
+class BatchPanner
+{
+public:
+  static constexpr int lanes = 16;
+
+  // unit (or any length) direction per speaker, in output order
+  void setSpeakers(const std::vector<float> &x, const std::vector<float> &y,
+                   const std::vector<float> &z)
+  {
+    numSpeakers = (int)x.size();
+    stride = (numSpeakers + lanes - 1) / lanes * lanes;
+    for (auto *a : {&sx, &sy, &sz, &mask})
+    {
+      a->assign(stride, 0.0f);
+    }
+    for (int k = 0; k < numSpeakers; k++)
+    {
+      float m = std::sqrt(x[k] * x[k] + y[k] * y[k] + z[k] * z[k]);
+      sx[k] = x[k] / m;
+      sy[k] = y[k] / m;
+      sz[k] = z[k] / m;
+      mask[k] = 1;
+    }
+    resizeSources(numSources);
+  }
+
+  void spread(float radians) { cosSpread = std::cos(radians); }
+  void cacheAngle(float radians) { cosCache = std::cos(radians); }
+
+  void resizeSources(int n)
+  {
+    numSources = n;
+    gains.assign((size_t)n * stride, 0.0f);
+    previous.assign((size_t)n * stride, 0.0f);
+    for (auto *a : {&dx, &dy, &dz})
+    {
+      a->assign(n, 0.0f);
+    }
+    stale.assign(n, 1);
+    active.assign(n, std::vector<int>());
+    for (auto &a : active)
+    {
+      a.reserve(numSpeakers);
+    }
+    moved.reserve(n);
+  }
+
+  int sources() const { return numSources; }
+  int speakers() const { return numSpeakers; }
+
+  // position relative to the listener; only the direction matters
+  void setSource(int s, float x, float y, float z)
+  {
+    float m = std::sqrt(x * x + y * y + z * z);
+    if (m == 0)
+    {
+      return;
+    }
+    x /= m;
+    y /= m;
+    z /= m;
+    if (x * dx[s] + y * dy[s] + z * dz[s] < cosCache)
+    {
+      dx[s] = x;
+      dy[s] = y;
+      dz[s] = z;
+      stale[s] = 1;
+    }
+  }
+
+  const float *sourceGains(int s) const { return &gains[(size_t)s * stride]; }
+
+  // Recomputes gains of sources that moved. Called by render(); public so
+  // benchmarks can time it alone.
+  void updateGains()
+  {
+    std::copy(gains.begin(), gains.end(), previous.begin());
+    moved.clear();
+    for (int s = 0; s < numSources; s++)
+    {
+      if (stale[s])
+      {
+        moved.push_back(s);
+        stale[s] = 0;
+      }
+    }
+
+    const float c0 = cosSpread;
+    const float scale = 1 / std::max(1e-6f, 1 - cosSpread);
+    const float *__restrict px = sx.data();
+    const float *__restrict py = sy.data();
+    const float *__restrict pz = sz.data();
+    const float *__restrict pm = mask.data();
+    for (int s : moved)
+    {
+      float *__restrict g = &gains[(size_t)s * stride];
+      const float ux = dx[s], uy = dy[s], uz = dz[s];
+      for (int k = 0; k < stride; k++)
+      {
+        float c = px[k] * ux + py[k] * uy + pz[k] * uz;
+        float w = (c - c0) * scale;
+        g[k] = w > 0 ? w * pm[k] : 0;
+      }
+      // sum of squares in lanes, so it vectorizes without -ffast-math
+      float acc[lanes] = {};
+      for (int k = 0; k < stride; k += lanes)
+      {
+        for (int l = 0; l < lanes; l++)
+        {
+          acc[l] += g[k + l] * g[k + l];
+        }
+      }
+      float sum = 0;
+      for (int l = 0; l < lanes; l++)
+      {
+        sum += acc[l];
+      }
+      if (sum > 0)
+      {
+        float norm = 1 / std::sqrt(sum);
+        for (int k = 0; k < stride; k++)
+        {
+          g[k] *= norm;
+        }
+      }
+      else
+      {
+        // between speakers by more than the spread: use the nearest one
+        int best = 0;
+        float bestCos = -2;
+        for (int k = 0; k < numSpeakers; k++)
+        {
+          float c = sx[k] * ux + sy[k] * uy + sz[k] * uz;
+          if (c > bestCos)
+          {
+            bestCos = c;
+            best = k;
+          }
+        }
+        g[best] = 1;
+      }
+    }
+
+    for (int s : moved)
+    {
+      const float *g = &gains[(size_t)s * stride];
+      const float *p = &previous[(size_t)s * stride];
+      active[s].clear();
+      for (int k = 0; k < numSpeakers; k++)
+      {
+        if (g[k] != 0 || p[k] != 0)
+        {
+          active[s].push_back(k);
+        }
+      }
+    }
+  }
+
+  // in[s] is source s's block, out[k] speaker k's, which is added to.
+  void render(const float *const *in, float *const *out, int frames)
+  {
+    updateGains();
+    float invFrames = 1.0f / frames;
+    for (int s = 0; s < numSources; s++)
+    {
+      const float *__restrict src = in[s];
+      const float *g = &gains[(size_t)s * stride];
+      const float *p = &previous[(size_t)s * stride];
+      for (int k : active[s])
+      {
+        float *__restrict dst = out[k];
+        float g0 = p[k], dg = (g[k] - p[k]) * invFrames;
+        if (dg == 0)
+        {
+          for (int f = 0; f < frames; f++)
+          {
+            dst[f] += g0 * src[f];
+          }
+        }
+        else
+        {
+          for (int f = 0; f < frames; f++)
+          {
+            dst[f] += (g0 + dg * f) * src[f];
+          }
+        }
+      }
+    }
+  }
+
+private:
+  int numSpeakers = 0;
+  int stride = 0; // speakers rounded up to whole SIMD lanes
+  int numSources = 0;
+  float cosSpread = std::cos(0.8f);
+  float cosCache = std::cos(0.01f);
+
+  aligned_vector<float> sx, sy, sz, mask;
+  aligned_vector<float> gains, previous; // sources x stride
+  aligned_vector<float> dx, dy, dz;      // direction gains were made for
+  std::vector<char> stale;
+  std::vector<int> moved;
+  std::vector<std::vector<int>> active;
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+// Uniform cell grid of points that come and go one at a time.
+//
+// SpatialGrid is rebuilt from scratch every step, which suits agents that
+// all move. Things like food mostly sit still and change one at a time
+// (eaten, respawned somewhere else), so here each cell keeps its own list
+// and insert, remove and move are O(1): a point knows its cell and its
+// slot in it, and removal swaps the cell's last entry into the hole.
+//
+// Points are identified by small integer ids chosen by the caller. Like
+// SpatialGrid the grid covers [-halfExtent, halfExtent]^3 and clamps
+// strays into the border cells.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+struct DynamicGrid
+{
+  float cellSize = 1;
+  float invCellSize = 1;
+  float lo = -1;
+  int dim = 1;
+  int linearScanMax = 128;
+
+  // Drops every point. Cells are at least `minCellSize` wide, at most
+  // maxDim per side.
+  void configure(float halfExtent, float minCellSize, int maxDim = 64)
+  {
+    lo = -halfExtent;
+    dim = (int)std::floor(2 * halfExtent / minCellSize);
+    dim = std::max(1, std::min(dim, maxDim));
+    cellSize = 2 * halfExtent / dim;
+    invCellSize = 1 / cellSize;
+    cells.assign(dim * dim * dim, std::vector<int>());
+    x.clear();
+    y.clear();
+    z.clear();
+    cellOf.clear();
+    slotOf.clear();
+    count = 0;
+  }
+
+  int size() const { return count; }
+
+  bool contains(int id) const
+  {
+    return id >= 0 && id < (int)cellOf.size() && cellOf[id] >= 0;
+  }
+
+  int coord(float v) const
+  {
+    int c = (int)std::floor((v - lo) * invCellSize);
+    return c < 0 ? 0 : (c >= dim ? dim - 1 : c);
+  }
+
+  int cell(int cx, int cy, int cz) const { return (cz * dim + cy) * dim + cx; }
+
+  // Adds point `id` at (px, py, pz), or moves it there if it is already in.
+  void insert(int id, float px, float py, float pz)
+  {
+    if (id >= (int)cellOf.size())
+    {
+      x.resize(id + 1);
+      y.resize(id + 1);
+      z.resize(id + 1);
+      cellOf.resize(id + 1, -1);
+      slotOf.resize(id + 1, -1);
+    }
+    int c = cell(coord(px), coord(py), coord(pz));
+    x[id] = px;
+    y[id] = py;
+    z[id] = pz;
+    if (cellOf[id] == c)
+    {
+      return; // same cell, nothing to relink
+    }
+    remove(id);
+    cellOf[id] = c;
+    slotOf[id] = (int)cells[c].size();
+    cells[c].push_back(id);
+    count++;
+  }
+
+  void move(int id, float px, float py, float pz) { insert(id, px, py, pz); }
+
+  void remove(int id)
+  {
+    if (!contains(id))
+    {
+      return;
+    }
+    std::vector<int> &list = cells[cellOf[id]];
+    int last = list.back();
+    list[slotOf[id]] = last;
+    slotOf[last] = slotOf[id];
+    list.pop_back();
+    cellOf[id] = -1;
+    slotOf[id] = -1;
+    count--;
+  }
+
+  // The id of the point closest to p, or -1 if the grid is empty or
+  // nothing is within `maxDist`. Searches shells of cells outward from p's
+  // cell and stops once no closer point can be left; `dist` gets the
+  // distance found. Exact for queries inside the grid.
+  template <class Vec>
+  int nearest(const Vec &p, float maxDist = INFINITY,
+              float *dist = nullptr) const
+  {
+    int best = -1;
+    float bestD2 = maxDist * maxDist;
+    int cx = coord(p[0]), cy = coord(p[1]), cz = coord(p[2]);
+    // rings past this one are all outside the grid
+    int rMax = std::max({cx, cy, cz, dim - 1 - cx, dim - 1 - cy, dim - 1 - cz});
+
+    auto visit = [&](int c)
+    {
+      for (int id : cells[c])
+      {
+        float dx = x[id] - p[0], dy = y[id] - p[1], dz = z[id] - p[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        // ties go to the lower id, whatever the cell order
+        if (d2 < bestD2 || (d2 == bestD2 && best >= 0 && id < best))
+        {
+          bestD2 = d2;
+          best = id;
+        }
+      }
+    };
+
+    // a handful of points: scanning them beats walking the cells
+    if (count <= linearScanMax)
+    {
+      for (int id = 0; id < (int)cellOf.size(); id++)
+      {
+        float dx = x[id] - p[0], dy = y[id] - p[1], dz = z[id] - p[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (cellOf[id] >= 0 && d2 < bestD2)
+        {
+          bestD2 = d2;
+          best = id;
+        }
+      }
+      rMax = -1;
+    }
+
+    for (int r = 0; r <= rMax && count > 0; r++)
+    {
+      // anything in ring r is at least (r - 1) cells away
+      float reach = (r - 1) * cellSize;
+      if (r > 0 && reach * reach > bestD2)
+      {
+        break;
+      }
+      int z0 = std::max(cz - r, 0), z1 = std::min(cz + r, dim - 1);
+      int y0 = std::max(cy - r, 0), y1 = std::min(cy + r, dim - 1);
+      int x0 = std::max(cx - r, 0), x1 = std::min(cx + r, dim - 1);
+      for (int iz = z0; iz <= z1; iz++)
+      {
+        for (int iy = y0; iy <= y1; iy++)
+        {
+          if (std::abs(iz - cz) == r || std::abs(iy - cy) == r)
+          {
+            // a face of the shell: the whole row
+            for (int ix = x0; ix <= x1; ix++)
+            {
+              visit(cell(ix, iy, iz));
+            }
+            continue;
+          }
+          // inside the shell: only the two ends of the row
+          if (cx - r >= 0)
+          {
+            visit(cell(cx - r, iy, iz));
+          }
+          if (r > 0 && cx + r < dim)
+          {
+            visit(cell(cx + r, iy, iz));
+          }
+        }
+      }
+    }
+    if (dist)
+    {
+      *dist = best >= 0 ? std::sqrt(bestD2) : INFINITY;
+    }
+    return best;
+  }
+
+private:
+  std::vector<std::vector<int>> cells; // ids in each cell, any order
+  std::vector<float> x, y, z;          // per id
+  std::vector<int> cellOf, slotOf;     // -1 if the id is not in the grid
+  int count = 0;
+};
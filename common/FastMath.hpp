@@ -0,0 +1,88 @@
+#pragma once
+
+// Branch free approximations that the compiler can vectorize, unlike the
+// libm calls they replace.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// sin(2 pi p) for p in [0, 1). Absolute error below 3.6e-6.
+inline float sinCycle(float p)
+{
+  // fold onto [-1/4, 1/4] cycles, where sine is odd and monotonic
+  float x = p - 0.5f;        // sin(2 pi p) = -sin(2 pi x), x in [-1/2, 1/2)
+  float a = std::fabs(x);
+  float s = x < 0 ? 1.0f : -1.0f; // sign, with the negation above folded in
+  a = a > 0.25f ? 0.5f - a : a;
+  float z = a * 6.28318531f;
+  float z2 = z * z;
+  // Taylor series to z^9; worst case at z = pi/2
+  float poly =
+      z * (1 + z2 * (-1.0f / 6 +
+                     z2 * (1.0f / 120 +
+                           z2 * (-1.0f / 5040 + z2 * (1.0f / 362880)))));
+  return s * poly;
+}
+
+// sin(2 pi t) for |t| < 2^22. The whole cycles are dropped with an int
+// conversion rather than floor(), which would stop vectorization. Same
+// error bound as sinCycle, plus float rounding of t.
+inline float sinCycles(float t)
+{
+  float p = t - (float)(int)t;
+  p += p < 0 ? 1.0f : 0.0f;
+  return sinCycle(p);
+}
+
+// 1 / sqrt(x) for x > 0, relative error below 1.5e-7. std::sqrt keeps
+// loops scalar unless errno is off (-fno-math-errno), since it has to set
+// errno for negative input. x = 0 gives a large finite value, so x *
+// rsqrt(x) is still 0.
+inline float rsqrt(float x)
+{
+  uint32_t i;
+  std::memcpy(&i, &x, sizeof i);
+  i = 0x5f375a86u - (i >> 1);
+  float y;
+  std::memcpy(&y, &i, sizeof y);
+  float half = 0.5f * x;
+  for (int k = 0; k < 3; k++)
+  {
+    y = y * (1.5f - half * y * y); // Newton step
+  }
+  return y;
+}
+
+// acos(x) for x in [-1, 1], absolute error below 5e-7 (Abramowitz and
+// Stegun 4.4.46, plus float rounding).
+inline float acosApprox(float x)
+{
+  float a = std::fabs(x);
+  float poly =
+      1.5707963050f +
+      a * (-0.2145988016f +
+           a * (0.0889789874f +
+                a * (-0.0501743046f +
+                     a * (0.0308918810f +
+                          a * (-0.0170881256f +
+                               a * (0.0066700901f +
+                                    a * -0.0012624911f))))));
+  float r = (1 - a) * rsqrt(1 - a) * poly; // sqrt(1 - a), vectorizable
+  return x < 0 ? 3.14159265f - r : r;
+}
+
+// sin(z) for z in [0, pi], relative error below 3e-7 (Taylor series to
+// z^11 on [0, pi/2]). Unlike sinCycle it stays accurate relative to the
+// result near 0, so it can be divided by.
+inline float sinApprox(float z)
+{
+  // pi - z, with pi in two parts so the result is exact near pi
+  z = z > 1.57079633f ? (3.14159274f - z) - 8.742278e-8f : z;
+  float z2 = z * z;
+  return z * (1 + z2 * (-1.0f / 6 +
+                        z2 * (1.0f / 120 +
+                              z2 * (-1.0f / 5040 +
+                                    z2 * (1.0f / 362880 +
+                                          z2 * (-1.0f / 39916800))))));
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+// One mesh drawn many times with a single draw call.
+//
+// Drawing each agent with pushMatrix / translate / rotate / scale /
+// draw(mesh) costs a draw call and a matrix upload per object. Here the
+// mesh goes to the GPU once and every copy is an Instance: position,
+// rotation, scale and colour, 56 bytes. Fill `instances` each frame and
+// call draw(); the whole array is uploaded in one go (the old buffer is
+// orphaned, so the driver never waits for the previous frame) and drawn
+// with glDrawElementsInstanced. The shader reads one Instance per copy
+// from attributes 2 to 5; see instanced-vertex.glsl in Assignment4.
+//
+// Like PackedPointBuffer the GL objects live as long as the context, and
+// nothing here needs allolib beyond the GL header, so the same class runs
+// in a headless test.
+
+#include <cstddef>
+#include <vector>
+
+#if __has_include("al/graphics/al_OpenGL.hpp")
+#include "al/graphics/al_OpenGL.hpp"
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
+
+struct Instance
+{
+  float position[3];
+  float scale[3];
+  float quat[4]; // (w, x, y, z), al::Quat's order
+  float color[4];
+};
+
+class InstancedMesh
+{
+public:
+  std::vector<Instance> instances;
+
+  // Uploads the shape. `MeshT` is anything with al::Mesh's vertices(),
+  // normals(), indices() and primitive(), al::Mesh itself included. Needs
+  // the GL context.
+  template <class MeshT>
+  void setMesh(const MeshT &mesh)
+  {
+    primitive = (GLenum)mesh.primitive();
+    int n = (int)mesh.vertices().size();
+    // interleaved position and normal
+    std::vector<float> vertices(6 * n, 0.0f);
+    for (int i = 0; i < n; i++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        vertices[6 * i + c] = mesh.vertices()[i][c];
+        if (i < (int)mesh.normals().size())
+        {
+          vertices[6 * i + 3 + c] = mesh.normals()[i][c];
+        }
+      }
+    }
+    std::vector<unsigned int> indices(mesh.indices().begin(),
+                                      mesh.indices().end());
+    if (indices.empty())
+    {
+      for (int i = 0; i < n; i++)
+      {
+        indices.push_back(i);
+      }
+    }
+    indexCount = (int)indices.size();
+
+    if (!vao)
+    {
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &meshBuffer);
+      glGenBuffers(1, &indexBuffer);
+      glGenBuffers(1, &instanceBuffer);
+    }
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
+                 vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                          (const void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                          (const void *)(3 * sizeof(float)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+                 indices.data(), GL_STATIC_DRAW);
+
+    // per instance: position, scale, quat, color
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    const int sizes[] = {3, 3, 4, 4};
+    const size_t offsets[] = {offsetof(Instance, position),
+                              offsetof(Instance, scale),
+                              offsetof(Instance, quat),
+                              offsetof(Instance, color)};
+    for (int a = 0; a < 4; a++)
+    {
+      glEnableVertexAttribArray(2 + a);
+      glVertexAttribPointer(2 + a, sizes[a], GL_FLOAT, GL_FALSE,
+                            sizeof(Instance), (const void *)offsets[a]);
+      glVertexAttribDivisor(2 + a, 1);
+    }
+    glBindVertexArray(0);
+  }
+
+  // Draws every instance with whatever shader is bound; call g.update()
+  // first so it has this frame's matrices.
+  void draw()
+  {
+    if (!vao || instances.empty())
+    {
+      return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    GLsizeiptr bytes = instances.size() * sizeof(Instance);
+    glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+    glBindVertexArray(vao);
+    glDrawElementsInstanced(primitive, indexCount, GL_UNSIGNED_INT, nullptr,
+                            (GLsizei)instances.size());
+    glBindVertexArray(0);
+  }
+
+private:
+  GLuint vao = 0, meshBuffer = 0, indexBuffer = 0, instanceBuffer = 0;
+  GLenum primitive = GL_TRIANGLES;
+  int indexCount = 0;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+// Additive synthesis: a bank of sine voices summed into one signal.
+//
+// Frequencies and amplitudes are set once per block and ramped linearly
+// across it, so control changes don't click. Voices are stored as arrays
+// and processed `lanes` at a time with a polynomial sine (sinCycle, error
+// below 4e-6, about -108 dB), which the compiler turns into SIMD over
+// voices.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "AlignedAllocator.hpp"
+#include "FastMath.hpp"
+
+class OscillatorBank
+{
+public:
+  static constexpr int lanes = 16;
+
+  explicit OscillatorBank(int voices = 0, float sampleRate = 44100)
+  {
+    this->sampleRate(sampleRate);
+    resize(voices);
+  }
+
+  void sampleRate(float sr) { invSampleRate = 1 / sr; }
+
+  // Allocates scratch for blocks up to this long, so render() doesn't
+  // allocate on the audio thread.
+  void reserveFrames(int frames)
+  {
+    if ((int)mix.size() < frames * lanes)
+    {
+      mix.resize((size_t)frames * lanes);
+    }
+  }
+
+  // new voices start silent at 0 Hz
+  void resize(int voices)
+  {
+    numVoices = voices;
+    int padded = (voices + lanes - 1) / lanes * lanes;
+    for (auto *a : {&phase, &inc, &incTarget, &amp, &ampTarget})
+    {
+      a->resize(padded, 0.0f);
+    }
+    ramp.resize(2 * padded);
+  }
+
+  int size() const { return numVoices; }
+
+  // Takes effect over the next render() block. Frequencies are clamped to
+  // Nyquist.
+  void set(int voice, float frequency, float amplitude)
+  {
+    float i = frequency * invSampleRate;
+    incTarget[voice] = std::max(-0.5f, std::min(i, 0.5f));
+    ampTarget[voice] = amplitude;
+  }
+
+  // Adds `frames` samples of the sum of all voices into out.
+  void render(float *out, int frames)
+  {
+    int n = (int)phase.size();
+    if (n == 0 || frames <= 0)
+    {
+      return;
+    }
+
+    float *dInc = ramp.data();
+    float *dAmp = ramp.data() + n;
+    for (int v = 0; v < n; v++)
+    {
+      dInc[v] = (incTarget[v] - inc[v]) / frames;
+      dAmp[v] = (ampTarget[v] - amp[v]) / frames;
+    }
+
+    // Each group of `lanes` voices writes its own column of mix; the inner
+    // loop has no dependency between lanes, so it becomes SIMD.
+    reserveFrames(frames);
+    std::fill_n(mix.begin(), (size_t)frames * lanes, 0.0f);
+    for (int v = 0; v < n; v += lanes)
+    {
+      float ph[lanes], in[lanes], am[lanes], di[lanes], da[lanes];
+      for (int k = 0; k < lanes; k++)
+      {
+        ph[k] = phase[v + k];
+        in[k] = inc[v + k];
+        am[k] = amp[v + k];
+        di[k] = dInc[v + k];
+        da[k] = dAmp[v + k];
+      }
+      for (int f = 0; f < frames; f++)
+      {
+        float *m = mix.data() + f * lanes;
+        for (int k = 0; k < lanes; k++)
+        {
+          in[k] += di[k];
+          am[k] += da[k];
+          // |inc| < 1/2, so one correction wraps p back into [0, 1)
+          float p = ph[k] + in[k];
+          p -= p >= 1.0f ? 1.0f : 0.0f;
+          p += p < 0.0f ? 1.0f : 0.0f;
+          ph[k] = p;
+          m[k] += am[k] * sinCycle(p);
+        }
+      }
+      for (int k = 0; k < lanes; k++)
+      {
+        phase[v + k] = ph[k];
+      }
+    }
+    for (int f = 0; f < frames; f++)
+    {
+      const float *m = mix.data() + f * lanes;
+      float sum = 0;
+      for (int k = 0; k < lanes; k++)
+      {
+        sum += m[k];
+      }
+      out[f] += sum;
+    }
+
+    // land exactly on the targets despite rounding in the ramps
+    std::copy(incTarget.begin(), incTarget.end(), inc.begin());
+    std::copy(ampTarget.begin(), ampTarget.end(), amp.begin());
+  }
+
+private:
+  int numVoices = 0;
+  float invSampleRate = 1 / 44100.0f;
+  // phase in cycles, increment in cycles per sample
+  aligned_vector<float> phase, inc, incTarget;
+  aligned_vector<float> amp, ampTarget;
+  aligned_vector<float> ramp;
+  aligned_vector<float> mix;
+};
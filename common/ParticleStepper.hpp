@@ -0,0 +1,186 @@
+#pragma once
+
+// Time stepping for the particle.cpp sims.
+//
+// SEMI_IMPLICIT_EULER is what the sims have always done: v += a dt, then
+// x += v dt. VELOCITY_VERLET (kick, drift, kick; the same as leapfrog)
+// also costs one force evaluation per step, since each step reuses the
+// last one's acceleration, but it is second order and time symmetric:
+// with forces that depend only on position the energy stays bounded
+// instead of drifting. Drag is evaluated at the half-step velocity.
+//
+// Neither is stable once a step is long next to the fastest oscillation
+// or decay in the system (h w < 2 for a spring of frequency w). With
+// `adaptive` on, each frame's dt is split into substeps of dt / 2^k with
+// h w below `courant` (1, half that limit), where w is the larger of
+//   - maxRate, the fastest rate the app knows of (spring, drag), and
+//   - the stiffness seen in the last step, sqrt(|a' - a| / |x' - x|)
+//     at the 99th percentile over the particles. A pair crossing the
+//     charges' flip distance jumps in force with no oscillation behind
+//     it; taking the largest would let that one pair set every step.
+// A substep may also be at most twice the one before, so a system that
+// stiffens is caught before the estimate lags behind it. Calm frames take one
+// step; only stiff stretches are subdivided. With `adaptive` off a frame
+// is a single step of dt, as before, and the stiffness is not measured.
+//
+// Vec is anything with +=, -, * float and magSqr(), al::Vec3f included.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+enum Integrator
+{
+  SEMI_IMPLICIT_EULER,
+  VELOCITY_VERLET
+};
+
+template <class Vec>
+class ParticleStepper
+{
+public:
+  Integrator integrator = SEMI_IMPLICIT_EULER;
+  bool adaptive = false;
+  float courant = 1.0f; // h w at most this
+  float maxRate = 0;    // 1 / time; 0 for none known
+  int maxSubsteps = 64; // a power of two
+
+  long evaluations = 0; // calls to accel so far
+  int substeps = 0;     // in the last advance()
+
+  // The cached acceleration is stale; call after changing positions or
+  // velocities outside advance().
+  void invalidate() { haveAccel = false; }
+
+  // Advances x and v by dt. accel(x, v, a) fills a with every particle's
+  // acceleration.
+  template <class Accel>
+  void advance(std::vector<Vec> &x, std::vector<Vec> &v, float dt,
+               Accel &&accel)
+  {
+    int n = (int)x.size();
+    if ((int)a.size() != n)
+    {
+      a.resize(n);
+      haveAccel = havePrevious = false;
+    }
+    auto evaluate = [&]
+    {
+      accel(x, v, a);
+      evaluations++;
+      if (adaptive)
+      {
+        measureStiffness(x);
+      }
+    };
+    if (!adaptive)
+    {
+      // nothing measured while off: turned on, it starts over
+      havePrevious = false;
+      stiffness = 0;
+    }
+
+    substeps = 0;
+    float remaining = dt;
+    while (remaining > 0)
+    {
+      if (integrator == SEMI_IMPLICIT_EULER || !haveAccel)
+      {
+        evaluate();
+        haveAccel = true;
+      }
+      float h = remaining;
+      if (adaptive)
+      {
+        // The longest dt / 2^k within the bound. The step only changes
+        // when the bound crosses a power of two and stays put between,
+        // which Verlet needs to keep its energy from drifting.
+        float limit = bound();
+        h = dt;
+        for (int k = 1; h > limit && k < maxSubsteps; k *= 2)
+        {
+          h /= 2;
+        }
+        h = std::min(h, remaining);
+      }
+      remaining = leftAfter(h, remaining);
+      lastStep = h;
+
+      if (integrator == SEMI_IMPLICIT_EULER)
+      {
+        for (int i = 0; i < n; i++)
+        {
+          v[i] += a[i] * h;
+          x[i] += v[i] * h;
+        }
+        haveAccel = false;
+      }
+      else
+      {
+        for (int i = 0; i < n; i++)
+        {
+          v[i] += a[i] * (h / 2);
+          x[i] += v[i] * h;
+        }
+        evaluate();
+        for (int i = 0; i < n; i++)
+        {
+          v[i] += a[i] * (h / 2);
+        }
+      }
+      substeps++;
+    }
+  }
+
+private:
+  // the longest substep allowed now
+  float bound() const
+  {
+    float rate = std::max(maxRate, std::sqrt(stiffness));
+    float h = rate > 0 ? courant / rate : INFINITY;
+    return lastStep > 0 ? std::min(h, 2 * lastStep) : h;
+  }
+
+  // w^2 from how far each particle's acceleration moved since the last
+  // evaluation, over how far it did; the 99th percentile of those
+  void measureStiffness(const std::vector<Vec> &x)
+  {
+    int n = (int)x.size();
+    if (havePrevious)
+    {
+      rates.clear();
+      for (int i = 0; i < n; i++)
+      {
+        float dx2 = (x[i] - previousX[i]).magSqr();
+        float da2 = (a[i] - previousA[i]).magSqr();
+        if (dx2 > 0)
+        {
+          rates.push_back(std::sqrt(da2 / dx2));
+        }
+      }
+      stiffness = 0;
+      if (!rates.empty())
+      {
+        auto kth = rates.end() - 1 - rates.size() / 100;
+        std::nth_element(rates.begin(), kth, rates.end());
+        stiffness = *kth;
+      }
+    }
+    previousX = x;
+    previousA = a;
+    havePrevious = true;
+  }
+
+  // what is left after a step of h; exactly 0 for the last one, so float
+  // rounding never adds a sliver of a step
+  static float leftAfter(float h, float remaining)
+  {
+    return h >= remaining * (1 - 1e-6f) ? 0 : remaining - h;
+  }
+
+  std::vector<Vec> a, previousX, previousA;
+  std::vector<float> rates; // per particle, for the percentile
+  bool haveAccel = false, havePrevious = false;
+  float stiffness = 0; // w^2
+  float lastStep = 0;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+// Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC 2011).
+//
+// There is no stream to advance. A draw is a pure function of the key (the
+// seed) and a counter, here (particle, step, draw), so particle i at step s
+// gets the same numbers whichever thread computes it, in whatever order,
+// with no locks and no per-thread state. A parallel run matches a serial
+// one exactly and a run is reproduced by its seed. `draw` numbers the
+// blocks of four words when one (particle, step) needs more than four.
+//
+// The batch versions fill arrays for a run of consecutive particles; their
+// loops have no branches, so the compiler vectorizes the 32 x 32 bit
+// multiplies.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+class Philox
+{
+public:
+  // Generators with the same seed but different `purpose` are independent,
+  // e.g. one for the initial scatter and one for food respawns.
+  explicit Philox(uint64_t seed = 0, uint32_t purpose = 0)
+      : key0((uint32_t)seed),
+        key1((uint32_t)(seed >> 32) + purpose * 0x9E3779B9u) {}
+
+  // four random words
+  std::array<uint32_t, 4> bits(uint32_t particle, uint64_t step,
+                               uint32_t draw = 0) const
+  {
+    uint32_t c0 = particle, c1 = (uint32_t)step, c2 = (uint32_t)(step >> 32),
+             c3 = draw;
+    rounds(c0, c1, c2, c3, key0, key1);
+    return {c0, c1, c2, c3};
+  }
+
+  // four numbers in [0, 1)
+  std::array<float, 4> uniform4(uint32_t particle, uint64_t step,
+                                uint32_t draw = 0) const
+  {
+    auto b = bits(particle, step, draw);
+    return {toUniform(b[0]), toUniform(b[1]), toUniform(b[2]),
+            toUniform(b[3])};
+  }
+
+  float uniform(uint32_t particle, uint64_t step, uint32_t draw = 0) const
+  {
+    return toUniform(bits(particle, step, draw)[0]);
+  }
+
+  // a point in the cube [-1, 1)^3
+  std::array<float, 3> uniformS3(uint32_t particle, uint64_t step,
+                                 uint32_t draw = 0) const
+  {
+    auto b = bits(particle, step, draw);
+    return {toUniformS(b[0]), toUniformS(b[1]), toUniformS(b[2])};
+  }
+
+  // A point in the unit ball, by rejection like rnd::ball, trying draw
+  // `draw`, `draw + 1`, ... in turn.
+  std::array<float, 3> ball(uint32_t particle, uint64_t step,
+                            uint32_t draw = 0) const
+  {
+    while (true)
+    {
+      auto p = uniformS3(particle, step, draw++);
+      if (p[0] * p[0] + p[1] * p[1] + p[2] * p[2] <= 1)
+      {
+        return p;
+      }
+    }
+  }
+
+  // two independent standard normals (Box-Muller)
+  std::array<float, 2> normal2(uint32_t particle, uint64_t step,
+                               uint32_t draw = 0) const
+  {
+    auto b = bits(particle, step, draw);
+    // (0, 1], so the log is finite
+    float u = ((b[0] >> 8) + 1) * (1.0f / 16777216.0f);
+    float r = std::sqrt(-2 * std::log(u));
+    float a = toUniform(b[1]) * 6.2831853f;
+    return {r * std::cos(a), r * std::sin(a)};
+  }
+
+  float normal(uint32_t particle, uint64_t step, uint32_t draw = 0) const
+  {
+    return normal2(particle, step, draw)[0];
+  }
+
+  // uniformS3() for particles [first, first + n) at `step`, into
+  // x[0..n), y[0..n), z[0..n)
+  void uniformS3(int n, uint32_t first, uint64_t step, float *__restrict x,
+                 float *__restrict y, float *__restrict z,
+                 uint32_t draw = 0) const
+  {
+    const uint32_t k0 = key0, k1 = key1;
+    const uint32_t s0 = (uint32_t)step, s1 = (uint32_t)(step >> 32);
+    for (int k = 0; k < n; k++)
+    {
+      uint32_t c0 = first + k, c1 = s0, c2 = s1, c3 = draw;
+      rounds(c0, c1, c2, c3, k0, k1);
+      x[k] = toUniformS(c0);
+      y[k] = toUniformS(c1);
+      z[k] = toUniformS(c2);
+    }
+  }
+
+  // uniform() for particles [first, first + n) at `step`
+  void uniform(int n, uint32_t first, uint64_t step, float *__restrict out,
+               uint32_t draw = 0) const
+  {
+    const uint32_t k0 = key0, k1 = key1;
+    const uint32_t s0 = (uint32_t)step, s1 = (uint32_t)(step >> 32);
+    for (int k = 0; k < n; k++)
+    {
+      uint32_t c0 = first + k, c1 = s0, c2 = s1, c3 = draw;
+      rounds(c0, c1, c2, c3, k0, k1);
+      out[k] = toUniform(c0);
+    }
+  }
+
+private:
+  // the top 24 bits, which a float holds exactly
+  static float toUniform(uint32_t b) { return (b >> 8) * (1.0f / 16777216.0f); }
+  static float toUniformS(uint32_t b)
+  {
+    return (b >> 8) * (2.0f / 16777216.0f) - 1.0f;
+  }
+
+  static void rounds(uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3,
+                     uint32_t k0, uint32_t k1)
+  {
+    for (int r = 0; r < 10; r++)
+    {
+      uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+      uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+      uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+      uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+      c1 = (uint32_t)p1;
+      c3 = (uint32_t)p0;
+      c0 = n0;
+      c2 = n2;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+  }
+
+  uint32_t key0, key1;
+};
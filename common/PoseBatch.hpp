@@ -0,0 +1,364 @@
+#pragma once
+
+// Nav-style steering for whole arrays of agents.
+//
+// al::Nav keeps one pose per object, in doubles, and every faceToward(),
+// moveF() and step() is a separate call. Here poses are structure-of-arrays
+// floats and each operation has two versions: a scalar reference that
+// follows Nav's math one agent at a time, and a batch version over a range
+// of agents that uses the branch free FastMath helpers so the compiler can
+// turn it into SIMD. One batch turn lands within about 3e-5 of the
+// reference; most of that is acos near 0, where rounding in the cosine
+// already moves the angle that much.
+//
+// turnToward and turnTowardBatch do the same for bare unit forward vectors,
+// for agents that never need a full orientation.
+
+#include <array>
+#include <cmath>
+
+#include "AlignedAllocator.hpp"
+#include "FastMath.hpp"
+
+// Rotates the unit vector (fx, fy, fz) toward (tx, ty, tz) by `amt` of the
+// angle between them, like Nav::faceToward does for the forward vector.
+// (tx, ty, tz) need not be normalized. With `approx` the slerp angles come
+// from acosApprox and sinApprox instead of libm, which moves the result by
+// about 1e-6.
+template <bool approx = false>
+inline void turnToward(float &fx, float &fy, float &fz, float tx, float ty,
+                       float tz, float amt)
+{
+  float tm = std::sqrt(tx * tx + ty * ty + tz * tz);
+  if (tm == 0)
+  {
+    return;
+  }
+  tx /= tm;
+  ty /= tm;
+  tz /= tm;
+
+  float c = fx * tx + fy * ty + fz * tz;
+  c = c > 1 ? 1 : (c < -1 ? -1 : c);
+  float theta = approx ? acosApprox(c) : std::acos(c);
+  float s = approx ? sinApprox(theta) : std::sin(theta);
+
+  if (s < 1e-6f)
+  {
+    if (c > 0)
+    {
+      return; // already facing it
+    }
+    // facing away: any perpendicular axis will do
+    float px = -fy, py = fx, pz = 0;
+    if (std::fabs(fz) > 0.9f)
+    {
+      px = 0;
+      py = -fz;
+      pz = fy;
+    }
+    float pm = std::sqrt(px * px + py * py + pz * pz);
+    tx = px / pm;
+    ty = py / pm;
+    tz = pz / pm;
+    theta = (float)M_PI;
+    float a = std::cos(amt * theta), b = std::sin(amt * theta);
+    fx = a * fx + b * tx;
+    fy = a * fy + b * ty;
+    fz = a * fz + b * tz;
+    return;
+  }
+
+  // slerp between two unit vectors
+  float a, b;
+  if (approx)
+  {
+    a = sinApprox((1 - amt) * theta) / s;
+    b = sinApprox(amt * theta) / s;
+  }
+  else
+  {
+    a = std::sin((1 - amt) * theta) / s;
+    b = std::sin(amt * theta) / s;
+  }
+  fx = a * fx + b * tx;
+  fy = a * fy + b * ty;
+  fz = a * fz + b * tz;
+  float m = 1 / std::sqrt(fx * fx + fy * fy + fz * fz);
+  fx *= m;
+  fy *= m;
+  fz *= m;
+}
+
+// turnToward<true> for f[k] toward t[k] by amt[k], k in [0, n). The cases
+// turnToward branches on are selects here. A zero target or amount leaves
+// f[k] as it is.
+inline void turnTowardBatch(int n, float *__restrict fx, float *__restrict fy,
+                            float *__restrict fz, const float *__restrict tx,
+                            const float *__restrict ty,
+                            const float *__restrict tz,
+                            const float *__restrict amt)
+{
+  for (int k = 0; k < n; k++)
+  {
+    float x = fx[k], y = fy[k], z = fz[k];
+    float t2 = tx[k] * tx[k] + ty[k] * ty[k] + tz[k] * tz[k];
+    float ti = rsqrt(t2);
+    float ux = tx[k] * ti, uy = ty[k] * ti, uz = tz[k] * ti;
+
+    float c = x * ux + y * uy + z * uz;
+    c = c > 1 ? 1 : (c < -1 ? -1 : c);
+    bool away = c < 0;
+    float theta = acosApprox(c);
+    float s = sinApprox(theta);
+    bool degenerate = s < 1e-6f;
+
+    // facing away: rotate about an axis perpendicular to f instead
+    bool flat = std::fabs(z) > 0.9f;
+    float px = flat ? 0 : -y, py = flat ? -z : x, pz = flat ? y : 0;
+    float pi = rsqrt(px * px + py * py + pz * pz);
+    bool flip = degenerate ? away : false;
+    ux = flip ? px * pi : ux;
+    uy = flip ? py * pi : uy;
+    uz = flip ? pz * pi : uz;
+    theta = flip ? 3.14159265f : theta;
+
+    float a = amt[k];
+    float sa = sinApprox(a * theta);
+    float ca = sinApprox(1.57079633f - a * theta); // cos, a * theta in [0, pi]
+    float sr = sinApprox((1 - a) * theta);
+    float inv = degenerate ? 0 : 1 / s;
+    // slerp weights; a flip rotates in the plane of f and the axis
+    float wf = flip ? ca : sr * inv;
+    float wt = flip ? sa : sa * inv;
+    bool still = t2 == 0 ? true : (degenerate ? !away : false);
+    wf = still ? 1 : wf;
+    wt = still ? 0 : wt;
+
+    x = wf * x + wt * ux;
+    y = wf * y + wt * uy;
+    z = wf * z + wt * uz;
+    float m = rsqrt(x * x + y * y + z * z);
+    fx[k] = x * m;
+    fy[k] = y * m;
+    fz[k] = z * m;
+  }
+}
+
+// Positions and orientations of a group of agents. Orientations are unit
+// quaternions (w, x, y, z) in al::Quat's convention, so the forward vector
+// uf() is the rotated -z axis. speed[i] is what Nav::moveF() sets; step()
+// moves each agent that far along its forward vector.
+struct PoseBatch
+{
+  aligned_vector<float> x, y, z;
+  aligned_vector<float> qw, qx, qy, qz;
+  aligned_vector<float> speed;
+
+  int size() const { return (int)x.size(); }
+
+  // new agents sit at the origin facing -z, not moving
+  void resize(int n)
+  {
+    for (auto *a : {&x, &y, &z, &qx, &qy, &qz, &speed})
+    {
+      a->resize(n, 0.0f);
+    }
+    qw.resize(n, 1.0f);
+  }
+
+  std::array<float, 3> position(int i) const { return {x[i], y[i], z[i]}; }
+  std::array<float, 4> quat(int i) const { return {qw[i], qx[i], qy[i], qz[i]}; }
+
+  void setPosition(int i, float px, float py, float pz)
+  {
+    x[i] = px;
+    y[i] = py;
+    z[i] = pz;
+  }
+
+  std::array<float, 3> uf(int i) const
+  {
+    float w = qw[i], a = qx[i], b = qy[i], c = qz[i];
+    return {-2 * (a * c + w * b), -2 * (b * c - w * a),
+            -(1 - 2 * (a * a + b * b))};
+  }
+
+  void moveF(int i, float v) { speed[i] = v; }
+
+  void moveF(float v, int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      speed[i] = v;
+    }
+  }
+
+  // Nav::faceToward(point, amt), one agent: turns by `amt` of the shortest
+  // arc from uf() to the direction of the point. Scalar reference for the
+  // batch versions.
+  void faceToward(int i, float px, float py, float pz, float amt)
+  {
+    double tx = px - x[i], ty = py - y[i], tz = pz - z[i];
+    double tm = std::sqrt(tx * tx + ty * ty + tz * tz);
+    if (tm == 0 || amt == 0)
+    {
+      return;
+    }
+    tx /= tm;
+    ty /= tm;
+    tz /= tm;
+
+    std::array<float, 3> f = uf(i);
+    double c = f[0] * tx + f[1] * ty + f[2] * tz;
+    // rotation axis f x t; its length is sin(theta)
+    double ax = f[1] * tz - f[2] * ty, ay = f[2] * tx - f[0] * tz,
+           az = f[0] * ty - f[1] * tx;
+    double s = std::sqrt(ax * ax + ay * ay + az * az);
+    double theta = std::atan2(s, c);
+    if (c >= 1)
+    {
+      return;
+    }
+    if (s < 1e-6)
+    {
+      if (c > 0)
+      {
+        return;
+      }
+      // half a turn about any axis perpendicular to f, as Quat does
+      ax = 0;
+      ay = -f[2];
+      az = f[1];
+      if (ay * ay + az * az == 0)
+      {
+        ax = f[2];
+        ay = 0;
+        az = -f[0];
+      }
+      s = std::sqrt(ax * ax + ay * ay + az * az);
+      theta = M_PI;
+    }
+    double h = 0.5 * amt * theta;
+    double sh = std::sin(h) / s;
+    rotate(i, std::cos(h), ax * sh, ay * sh, az * sh);
+  }
+
+  // faceToward() for agents [begin, end), each toward its own point
+  // (px[i], py[i], pz[i]) by amt[i]. Arrays are indexed by agent.
+  void faceToward(const float *px, const float *py, const float *pz,
+                  const float *amt, int begin, int end)
+  {
+    faceTowardRange(end - begin, x.data() + begin, y.data() + begin,
+                    z.data() + begin, qw.data() + begin, qx.data() + begin,
+                    qy.data() + begin, qz.data() + begin, px + begin,
+                    py + begin, pz + begin, amt + begin);
+  }
+
+  // Nav::moveF(speed[i]) and Nav::step() for agents [begin, end): each
+  // moves along its forward vector.
+  void step(int begin, int end)
+  {
+    stepRange(end - begin, x.data() + begin, y.data() + begin,
+              z.data() + begin, qw.data() + begin, qx.data() + begin,
+              qy.data() + begin, qz.data() + begin, speed.data() + begin);
+  }
+
+  void step() { step(0, size()); }
+
+private:
+  // q = r * q, renormalized
+  void rotate(int i, double rw, double rx, double ry, double rz)
+  {
+    double w = qw[i], a = qx[i], b = qy[i], c = qz[i];
+    double nw = rw * w - rx * a - ry * b - rz * c;
+    double na = rw * a + rx * w + ry * c - rz * b;
+    double nb = rw * b - rx * c + ry * w + rz * a;
+    double nc = rw * c + rx * b - ry * a + rz * w;
+    double m = 1 / std::sqrt(nw * nw + na * na + nb * nb + nc * nc);
+    qw[i] = nw * m;
+    qx[i] = na * m;
+    qy[i] = nb * m;
+    qz[i] = nc * m;
+  }
+
+  static void faceTowardRange(int n, const float *__restrict x,
+                              const float *__restrict y,
+                              const float *__restrict z, float *__restrict qw,
+                              float *__restrict qx, float *__restrict qy,
+                              float *__restrict qz, const float *__restrict px,
+                              const float *__restrict py,
+                              const float *__restrict pz,
+                              const float *__restrict amt)
+  {
+    for (int k = 0; k < n; k++)
+    {
+      float w = qw[k], a = qx[k], b = qy[k], c = qz[k];
+      float fx = -2 * (a * c + w * b), fy = -2 * (b * c - w * a),
+            fz = -(1 - 2 * (a * a + b * b));
+
+      float tx = px[k] - x[k], ty = py[k] - y[k], tz = pz[k] - z[k];
+      float t2 = tx * tx + ty * ty + tz * tz;
+      float ti = rsqrt(t2);
+      tx *= ti;
+      ty *= ti;
+      tz *= ti;
+
+      float cs = fx * tx + fy * ty + fz * tz;
+      cs = cs > 1 ? 1 : (cs < -1 ? -1 : cs);
+      float ax = fy * tz - fz * ty, ay = fz * tx - fx * tz,
+            az = fx * ty - fy * tx;
+      float s2 = ax * ax + ay * ay + az * az;
+
+      // facing away: the half turn axis of the scalar version
+      bool away = cs < 0;
+      bool degenerate = s2 < 1e-12f;
+      float bx = 0, by = -fz, bz = fy;
+      bool zAxis = by * by + bz * bz == 0;
+      bx = zAxis ? fz : bx;
+      by = zAxis ? 0 : by;
+      bz = zAxis ? -fx : bz;
+      bool flip = degenerate ? away : false;
+      ax = flip ? bx : ax;
+      ay = flip ? by : ay;
+      az = flip ? bz : az;
+      s2 = flip ? bx * bx + by * by + bz * bz : s2;
+
+      float si = rsqrt(s2);
+      float h = 0.5f * amt[k] * acosApprox(cs); // in [0, pi / 2]
+      float sh = sinApprox(h) * si;
+      float ch = sinApprox(1.57079633f - h);
+      bool still = t2 == 0 ? true : (degenerate ? !away : false);
+      sh = still ? 0 : sh;
+      ch = still ? 1 : ch;
+
+      float rx = ax * sh, ry = ay * sh, rz = az * sh;
+      float nw = ch * w - rx * a - ry * b - rz * c;
+      float na = ch * a + rx * w + ry * c - rz * b;
+      float nb = ch * b - rx * c + ry * w + rz * a;
+      float nc = ch * c + rx * b - ry * a + rz * w;
+      float m = rsqrt(nw * nw + na * na + nb * nb + nc * nc);
+      qw[k] = nw * m;
+      qx[k] = na * m;
+      qy[k] = nb * m;
+      qz[k] = nc * m;
+    }
+  }
+
+  static void stepRange(int n, float *__restrict x, float *__restrict y,
+                        float *__restrict z, const float *__restrict qw,
+                        const float *__restrict qx,
+                        const float *__restrict qy,
+                        const float *__restrict qz,
+                        const float *__restrict speed)
+  {
+    for (int k = 0; k < n; k++)
+    {
+      float w = qw[k], a = qx[k], b = qy[k], c = qz[k];
+      float v = speed[k];
+      x[k] -= 2 * (a * c + w * b) * v;
+      y[k] -= 2 * (b * c - w * a) * v;
+      z[k] -= (1 - 2 * (a * a + b * b)) * v;
+    }
+  }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+// Uniform cell grid for fixed-radius neighbor queries.
+//
+// The grid covers the cube [-halfExtent, halfExtent]^3. Anything outside
+// is clamped into the border cells, so queries stay correct for stray
+// particles, they just get slower. Rebuilt from scratch every step with a
+// counting sort: no per-cell allocation, and the members of a cell are
+// contiguous in `sorted`.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+struct SpatialGrid
+{
+  float cellSize = 1;
+  float invCellSize = 1;
+  float lo = -1;
+  int dim = 1;
+
+  std::vector<int> cellStart; // dim^3 + 1 offsets into sorted
+  std::vector<int> sorted;    // particle indices ordered by cell
+  std::vector<int> cellOf;    // cell of each particle at build time
+
+  // Cells are at least `minCellSize` wide (the query radius, usually) but
+  // the grid never gets more than maxDim cells per side.
+  void configure(float halfExtent, float minCellSize, int maxDim = 64)
+  {
+    lo = -halfExtent;
+    dim = (int)std::floor(2 * halfExtent / minCellSize);
+    dim = std::max(1, std::min(dim, maxDim));
+    cellSize = 2 * halfExtent / dim;
+    invCellSize = 1 / cellSize;
+  }
+
+  int coord(float v) const
+  {
+    int c = (int)std::floor((v - lo) * invCellSize);
+    return c < 0 ? 0 : (c >= dim ? dim - 1 : c);
+  }
+
+  int cell(int cx, int cy, int cz) const { return (cz * dim + cy) * dim + cx; }
+
+  // pos(i) returns anything indexable with [0], [1], [2]
+  template <class PosFn>
+  void build(int n, PosFn pos)
+  {
+    int cells = dim * dim * dim;
+    cellStart.assign(cells + 1, 0);
+    cellOf.resize(n);
+    sorted.resize(n);
+
+    for (int i = 0; i < n; i++)
+    {
+      auto p = pos(i);
+      int c = cell(coord(p[0]), coord(p[1]), coord(p[2]));
+      cellOf[i] = c;
+      cellStart[c + 1]++;
+    }
+    for (int c = 0; c < cells; c++)
+    {
+      cellStart[c + 1] += cellStart[c];
+    }
+    // fill in reverse so each cell ends up in ascending index order
+    std::vector<int> &next = scratch;
+    next.assign(cellStart.begin() + 1, cellStart.end());
+    for (int i = n - 1; i >= 0; i--)
+    {
+      sorted[--next[cellOf[i]]] = i;
+    }
+  }
+
+  // Calls fn(begin, end) for each run sorted[begin, end) of particles in
+  // the cells overlapping the box of half-width `radius` around p, one per
+  // row of cells along x (those are adjacent in `sorted`).
+  template <class Vec, class Fn>
+  void forEachRange(const Vec &p, float radius, Fn fn) const
+  {
+    int x0 = coord(p[0] - radius), x1 = coord(p[0] + radius);
+    int y0 = coord(p[1] - radius), y1 = coord(p[1] + radius);
+    int z0 = coord(p[2] - radius), z1 = coord(p[2] + radius);
+    for (int z = z0; z <= z1; z++)
+    {
+      for (int y = y0; y <= y1; y++)
+      {
+        fn(cellStart[cell(x0, y, z)], cellStart[cell(x1, y, z) + 1]);
+      }
+    }
+  }
+
+  // Calls fn(j) for every particle in the cells overlapping the box of
+  // half-width `radius` around p. Callers do the exact distance test.
+  template <class Vec, class Fn>
+  void forEachCandidate(const Vec &p, float radius, Fn fn) const
+  {
+    auto visitRange = [&](int begin, int end)
+    {
+      for (int k = begin; k < end; k++)
+      {
+        fn(sorted[k]);
+      }
+    };
+    forEachRange(p, radius, visitRange);
+  }
+
+private:
+  std::vector<int> scratch;
+};
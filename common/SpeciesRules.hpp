@@ -0,0 +1,261 @@
+#pragma once
+
+// Steering rules for groups of agents, as template policies.
+//
+// A species is a PoseBatch table. What its agents do is a list of rules,
+// chosen at compile time:
+//
+//   SelfKernel<Rules...> runs rules each agent applies on its own (head
+//   home, follow the group, seek food). Each rule aims every agent at a
+//   point; the turns are done with the batch PoseBatch::faceToward. All
+//   rules run block by block, so the table is walked once however many
+//   rules there are.
+//
+//   PairKernel<Rules...> runs rules between one agent and its neighbors in
+//   another species (or its own). The candidates come from that species'
+//   SpatialGrid, the distance is computed once per pair, and every rule is
+//   inlined into the same loop, so a species pair costs one grid search
+//   however many rules it has. A third species is one more PairKernel in
+//   the same per-agent loop, not another pass.
+//
+// Rules run in the order they are listed, on the poses as the earlier
+// rules left them, so a kernel does exactly what the same rules written
+// out by hand would.
+//
+// A self rule has
+//   void prepare(const PoseBatch &p);   // once per run, before any turn
+//   void aim(const PoseBatch &p, int i, float &tx, float &ty, float &tz,
+//            float &amt);               // agent i's target and turn amount
+// and a pair rule has
+//   float radius;                       // how far it reaches
+//   void apply(const Pair &pair) const;
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include "AlignedAllocator.hpp"
+#include "PoseBatch.hpp"
+#include "SpatialGrid.hpp"
+
+// self rules with nothing to prepare can derive from this
+struct SelfRule
+{
+  void prepare(const PoseBatch &) {}
+};
+
+// Turns toward the origin by `amount` once farther than `radius` from it.
+struct ReturnHome : SelfRule
+{
+  float radius = 2, amount = 0;
+
+  void aim(const PoseBatch &p, int i, float &tx, float &ty, float &tz,
+           float &amt) const
+  {
+    tx = ty = tz = 0;
+    float d2 = p.x[i] * p.x[i] + p.y[i] * p.y[i] + p.z[i] * p.z[i];
+    amt = std::sqrt(d2) > radius ? amount : 0;
+  }
+};
+
+// Turns toward the point at the group's mean forward vector. That is what
+// the boids cohesion rule has always aimed at: close to the origin, so it
+// also keeps the flock together.
+struct Cohesion
+{
+  float amount = 0;
+  float mean[3] = {0, 0, 0};
+
+  void prepare(const PoseBatch &p)
+  {
+    mean[0] = mean[1] = mean[2] = 0;
+    for (int i = 0; i < p.size(); i++)
+    {
+      auto f = p.uf(i);
+      for (int c = 0; c < 3; c++)
+      {
+        mean[c] += f[c] / p.size();
+      }
+    }
+  }
+
+  void aim(const PoseBatch &, int, float &tx, float &ty, float &tz,
+           float &amt) const
+  {
+    tx = mean[0];
+    ty = mean[1];
+    tz = mean[2];
+    amt = amount;
+  }
+};
+
+template <class... Rules>
+struct SelfKernel
+{
+  std::tuple<Rules...> rules;
+
+  template <int k>
+  auto &rule() { return std::get<k>(rules); }
+
+  // agents per block: the targets of one block stay in L1
+  static constexpr int block = 512;
+
+  void run(PoseBatch &p)
+  {
+    int n = p.size();
+    for (auto *a : {&tx, &ty, &tz, &amt})
+    {
+      a->resize(n);
+    }
+    std::apply([&](auto &...r)
+               { (r.prepare(p), ...); },
+               rules);
+    for (int begin = 0; begin < n; begin += block)
+    {
+      int end = std::min(begin + block, n);
+      std::apply([&](auto &...r)
+                 { (turn(r, p, begin, end), ...); },
+                 rules);
+    }
+  }
+
+private:
+  template <class Rule>
+  void turn(Rule &r, PoseBatch &p, int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      r.aim(p, i, tx[i], ty[i], tz[i], amt[i]);
+    }
+    p.faceToward(tx.data(), ty.data(), tz.data(), amt.data(), begin, end);
+  }
+
+  aligned_vector<float> tx, ty, tz, amt;
+};
+
+// One pair of agents: agent i of a and agent k of b, positions pa and pb,
+// dif = pb - pa and its length d.
+struct Pair
+{
+  PoseBatch &a, &b;
+  int i, k;
+  float pa[3], pb[3], dif[3], d;
+
+  // point one unit ahead of the agent, pushed `sign` * dif
+  void turnA(float sign, float amount) const
+  {
+    auto f = a.uf(i);
+    a.faceToward(i, pa[0] + f[0] + sign * dif[0], pa[1] + f[1] + sign * dif[1],
+                 pa[2] + f[2] + sign * dif[2], amount);
+  }
+
+  void turnB(float sign, float amount) const
+  {
+    auto f = b.uf(k);
+    b.faceToward(k, pb[0] + f[0] + sign * dif[0], pb[1] + f[1] + sign * dif[1],
+                 pb[2] + f[2] + sign * dif[2], amount);
+  }
+};
+
+enum Side
+{
+  SIDE_A, // the agent the kernel runs for
+  SIDE_B  // its neighbor
+};
+
+// `who` steers away from the other one, by `amount`, within `radius`.
+template <Side who>
+struct Avoid
+{
+  float radius = 0, amount = 0;
+
+  void apply(const Pair &p) const
+  {
+    if (p.d < radius)
+    {
+      who == SIDE_A ? p.turnA(-1, amount) : p.turnB(1, amount);
+    }
+  }
+};
+
+// `who` steers toward the other one, by `amount`, within `radius`.
+template <Side who>
+struct Approach
+{
+  float radius = 0, amount = 0;
+
+  void apply(const Pair &p) const
+  {
+    if (p.d < radius)
+    {
+      who == SIDE_A ? p.turnA(1, amount) : p.turnB(-1, amount);
+    }
+  }
+};
+
+template <class... Rules>
+struct PairKernel
+{
+  std::tuple<Rules...> rules;
+
+  template <int k>
+  auto &rule() { return std::get<k>(rules); }
+
+  // the longest radius of any rule: what b's grid must be built for
+  float reach() const
+  {
+    return std::apply([](const auto &...r)
+                      { return std::max({r.radius...}); },
+                      rules);
+  }
+
+  // Applies the rules between agent i of `a` and every agent of `b` within
+  // reach, in index order. With `a` and `b` the same species, only
+  // neighbors after i, so each pair is seen once.
+  void run(PoseBatch &a, int i, PoseBatch &b, const SpatialGrid &gridB)
+  {
+    bool same = &a == &b;
+    float r = reach();
+    Pair pair{a, b, i, 0, {a.x[i], a.y[i], a.z[i]}, {0, 0, 0}, {0, 0, 0}, 0};
+
+    // Only neighbors within reach are kept, so the sort that restores
+    // index order sees a fraction of the grid's candidates.
+    near.clear();
+    auto collect = [&](int k)
+    {
+      if ((!same || k > i) && measure(pair, k) < r)
+      {
+        near.push_back(k);
+      }
+    };
+    gridB.forEachCandidate(pair.pa, r, collect);
+    std::sort(near.begin(), near.end());
+
+    for (int k : near)
+    {
+      pair.d = measure(pair, k);
+      std::apply([&](const auto &...rule)
+                 { (rule.apply(pair), ...); },
+                 rules);
+    }
+  }
+
+private:
+  // fills in pair.k, pb and dif for neighbor k and returns the distance
+  static float measure(Pair &pair, int k)
+  {
+    pair.k = k;
+    pair.pb[0] = pair.b.x[k];
+    pair.pb[1] = pair.b.y[k];
+    pair.pb[2] = pair.b.z[k];
+    float d2 = 0;
+    for (int c = 0; c < 3; c++)
+    {
+      pair.dif[c] = pair.pb[c] - pair.pa[c];
+      d2 += pair.dif[c] * pair.dif[c];
+    }
+    return std::sqrt(d2);
+  }
+
+  std::vector<int> near;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Bounded single-producer, single-consumer queue.
+//
+// A ring of `capacity` slots (rounded up to a power of two) with one index
+// per side. push() fails instead of waiting when the ring is full and
+// pop() fails when it is empty, so neither side ever blocks or allocates.
+// Unlike TripleBuffer every pushed item is delivered, in order.
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(size_t capacity = 1024)
+  {
+    size_t n = 1;
+    while (n < capacity)
+    {
+      n <<= 1;
+    }
+    slots.resize(n);
+    mask = n - 1;
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  size_t capacity() const { return slots.size(); }
+
+  // producer side: false if full, and the item is dropped
+  bool push(const T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - headCache == slots.size())
+    {
+      headCache = head.load(std::memory_order_acquire);
+      if (t - headCache == slots.size())
+      {
+        return false;
+      }
+    }
+    slots[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side: false if empty
+  bool pop(T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tailCache)
+    {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (h == tailCache)
+      {
+        return false;
+      }
+    }
+    item = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::vector<T> slots;
+  size_t mask = 0;
+
+  // each index on its own cache line; each side caches the other's
+  alignas(64) std::atomic<size_t> head{0};
+  size_t tailCache = 0; // consumer's
+  alignas(64) std::atomic<size_t> tail{0};
+  size_t headCache = 0; // producer's
+};
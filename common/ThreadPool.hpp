@@ -0,0 +1,143 @@
+#pragma once
+
+// Fixed set of worker threads for data-parallel loops.
+//
+// parallelFor hands out [begin, end) ranges of `grain` items from a shared
+// counter, runs some of them on the calling thread too, and returns once
+// every range is done. Which thread gets which range changes from call to
+// call, so callers must only write data owned by the index they are given.
+//
+// A range starts at a multiple of the grain but may be longer than one:
+// with no worker threads, or n <= grain, the whole loop is one call
+// fn(0, n). Per-grain scratch (say, a partial result per grain-sized
+// piece) must walk the pieces of its range, not assume a range is one.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // threads counts the calling thread; 0 means one per hardware thread
+  explicit ThreadPool(int threads = 0)
+  {
+    if (threads <= 0)
+    {
+      threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    for (int t = 1; t < threads; t++)
+    {
+      workers.emplace_back([this]
+                           { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quitting = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+    {
+      w.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int size() const { return (int)workers.size() + 1; }
+
+  // fn(begin, end) is called for consecutive ranges covering [0, n), each
+  // one grain long or, run on the calling thread alone, all of it
+  template <class Fn>
+  void parallelFor(int n, int grain, Fn &&fn)
+  {
+    grain = std::max(1, grain);
+    if (workers.empty() || n <= grain)
+    {
+      if (n > 0)
+      {
+        fn(0, n);
+      }
+      return;
+    }
+
+    std::function<void(int, int)> f(std::ref(fn));
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &f;
+      jobSize = n;
+      jobGrain = grain;
+      next = 0;
+      busy = (int)workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    runRanges();
+
+    // workers may still be inside their last range
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]
+              { return busy == 0; });
+    job = nullptr;
+  }
+
+private:
+  void runRanges()
+  {
+    while (true)
+    {
+      int begin = next.fetch_add(jobGrain);
+      if (begin >= jobSize)
+      {
+        return;
+      }
+      (*job)(begin, std::min(begin + jobGrain, jobSize));
+    }
+  }
+
+  void workerLoop()
+  {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      wake.wait(lock, [&]
+                { return quitting || generation != seen; });
+      if (quitting)
+      {
+        return;
+      }
+      seen = generation;
+      lock.unlock();
+      runRanges();
+      lock.lock();
+      if (--busy == 0)
+      {
+        done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool quitting = false;
+  uint64_t generation = 0;
+  int busy = 0;
+
+  std::function<void(int, int)> *job = nullptr;
+  int jobSize = 0;
+  int jobGrain = 1;
+  std::atomic<int> next{0};
+};
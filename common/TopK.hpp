@@ -0,0 +1,50 @@
+#pragma once
+
+// The K largest values seen, with their indices, largest first.
+//
+// Meant for parallel reductions: each range of a parallelFor fills its own
+// TopK and the partial results are merged afterwards. Ties go to the lower
+// index, so the result does not depend on how the input was split or in
+// which order the partials are merged.
+
+template <int K>
+struct TopK
+{
+  float value[K];
+  int index[K];
+  int count = 0;
+
+  void clear() { count = 0; }
+
+  void offer(float v, int i)
+  {
+    // cheap reject once full, which is nearly every call
+    if (count == K && !before(v, i, value[K - 1], index[K - 1]))
+    {
+      return;
+    }
+    int k = count < K ? count++ : K - 1;
+    while (k > 0 && before(v, i, value[k - 1], index[k - 1]))
+    {
+      value[k] = value[k - 1];
+      index[k] = index[k - 1];
+      k--;
+    }
+    value[k] = v;
+    index[k] = i;
+  }
+
+  void merge(const TopK &other)
+  {
+    for (int k = 0; k < other.count; k++)
+    {
+      offer(other.value[k], other.index[k]);
+    }
+  }
+
+private:
+  static bool before(float v, int i, float w, int j)
+  {
+    return v > w || (v == w && i < j);
+  }
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+// Single-producer, single-consumer triple buffer.
+//
+// The producer fills writeBuffer() and calls publish(); the consumer calls
+// update() and then reads read(). Each side owns one of the three slots and
+// they trade through the third with a single atomic exchange, so neither
+// side ever waits, locks or allocates, and the consumer always sees a whole
+// value, never a mix of two publishes. Values published between two
+// update() calls are skipped: the consumer only gets the latest.
+
+#include <atomic>
+#include <cstdint>
+
+template <class T>
+class TripleBuffer
+{
+public:
+  // producer side
+  T &writeBuffer() { return slots[back]; }
+
+  void publish()
+  {
+    uint8_t previous = shared.exchange(back | fresh, std::memory_order_acq_rel);
+    back = previous & indexMask;
+  }
+
+  // consumer side: true if a newer value was picked up
+  bool update()
+  {
+    if (!(shared.load(std::memory_order_relaxed) & fresh))
+    {
+      return false;
+    }
+    uint8_t previous = shared.exchange(front, std::memory_order_acq_rel);
+    front = previous & indexMask;
+    return true;
+  }
+
+  const T &read() const { return slots[front]; }
+
+private:
+  static constexpr uint8_t indexMask = 3;
+  static constexpr uint8_t fresh = 4;
+
+  T slots[3] = {};
+  uint8_t back = 0;               // producer's slot
+  std::atomic<uint8_t> shared{1}; // slot in transit, plus the fresh bit
+  uint8_t front = 2;              // consumer's slot
+};
@@ -1,6 +1,13 @@
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <random>
+#include <thread>
 #include <vector>
 #include "al/app/al_DistributedApp.hpp"
 #include "al/graphics/al_Image.hpp"
@@ -12,28 +19,82 @@
 
 #include "al/sphere/al_AlloSphereSpeakerLayout.hpp"
 #include "al/ui/al_Parameter.hpp"
-#include "Gamma/Oscillator.h"
 #include "al_ext/statedistribution/al_CuttleboneDomain.hpp"
 #include "al_ext/statedistribution/al_CuttleboneStateSimulationDomain.hpp"
+#include "../common/BatchPanner.hpp"
+#include "../common/SpscQueue.hpp"
+#include "../common/OscillatorBank.hpp"
+#include "../common/TripleBuffer.hpp"
+#include "PackedPointBuffer.hpp"
+#include "PhysarumSim.hpp"
+#include "SnapshotHistory.hpp"
+#include "StateEncoding.hpp"
 
 using namespace std;
 using namespace al;
-using namespace gam;
-
-Vec3f randomVec3f(float scale)
-{
-  return Vec3f(rnd::uniformS(), rnd::uniformS(), rnd::uniformS()) * scale;
-}
 
 string slurp(string fileName);
 
-const int numParticles = 1000;
+// Particles per state packet (8 bytes each, see StateEncoding.hpp). The
+// particle count itself is a runtime setting on the primary; replicas
+// learn it from the packets.
+const int chunkSize = 6144;
+// size of the chunkBlend array in packed-vertex.glsl
+const int maxChunks = 256;
+
+enum PannerMode
+{
+  LBAP,    // the tracked voice alone, through al::Lbap
+  CLUSTERS // tracked voice plus one voice per hue cluster, via BatchPanner
+};
 
+// Hue bins. Each one sounds as its own source, placed at the centroid of
+// the particles in it.
+const int numClusters = 64;
+
+// One slice of the particles. The primary sends a different chunk each
+// frame, round robin, and replicas copy it into their full arrays, so a
+// replica sees every particle updated once per ceil(numParticles /
+// chunkSize) frames. simTime says which step the chunk is from; replicas
+// draw between a chunk's last two steps (SnapshotHistory.hpp).
 struct CommonState
 {
   float pointSize;
-  Vec3f positions[numParticles];
-  HSV colors[numParticles];
+  int numParticles;
+  int chunk;
+  double simTime;
+  PackedParticle packed[chunkSize];
+};
+
+// seconds on a clock that never jumps
+double seconds()
+{
+  using namespace chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Jerkiest particles reported to the sound each step
+const int topJerks = PhysarumSim::topJerks;
+
+// A particle that was among the top jerks this step (rank >= 0) or whose
+// jerk rose past the event threshold (rank -1). Unlike the snapshot below,
+// every event reaches onSound.
+struct JerkEvent
+{
+  int particle;
+  int rank;
+  float jerk;
+  float hue;
+};
+
+// What onSound needs from the simulation, published once per step.
+struct AudioSnapshot
+{
+  Vec3f trackedPos;
+  Vec3f trackedVel;
+  Vec3f soundPos;
+  Vec3f clusterPos[numClusters];
+  float clusterLevel[numClusters] = {}; // share of the particles in the bin
 };
 
 struct MyApp : DistributedAppWithState<CommonState>
@@ -46,8 +107,27 @@ struct MyApp : DistributedAppWithState<CommonState>
   Parameter sphereK{"sphereK", "", 0.14, 0.01, .55};
   Parameter minDist{"minDist", "", 0.02, 0.0001, .25};
   Parameter moveRate{"moveRate", "", 0.055, 0.01, .25};
+  Parameter worldScale{"worldScale", "", 1, 0.25, 20};
+  ParameterMenu neighborMode{"neighborMode"};
+  ParameterMenu stepMode{"stepMode"};
+  ParameterMenu kernel{"kernel"};
+  ParameterMenu steering{"steering"};
+  ParameterMenu panner{"panner"};
+  Parameter jerkThreshold{"jerkThreshold", "", 0.01, 0.0, 0.05};
+  // steps per second; drawing is interpolated in between
+  Parameter simRate{"simRate", "", 60, 5, 120};
+  ParameterInt numThreads{"numThreads", "",
+                          max(1, (int)thread::hardware_concurrency()), 1, 64};
 
   Spatializer *spatializer{nullptr};
+  BatchPanner batchPanner;
+  // source 0 is the bus, the rest the cluster voices
+  vector<vector<float>> clusterAudio;
+  vector<const float *> sourceIn;
+  vector<float *> speakerOut;
+  vector<float> unusedOut; // for speakers past the device's channels
+  float clusterPhase[numClusters] = {};
+  float clusterAmp[numClusters] = {};
 
   ShaderProgram pointShader;
 
@@ -55,22 +135,35 @@ struct MyApp : DistributedAppWithState<CommonState>
 
   int maxDex = 0;
   Nav soundPos;
-
-  Sine<> osc1;
-  Sine<> osc2;
-  Sine<> osc3;
-  Sine<> osc4;
-  Sine<> osc5;
-  Sine<> osc6;
-
-  Nav particles[numParticles];
-  Vec3f oldPos[numParticles];
-  Vec3f vel[numParticles];
-  Vec3f oldVel[numParticles];
-  Vec3f acc[numParticles];
-  Vec3f oldAcc[numParticles];
-
-  Mesh mesh;
+  // sim -> audio thread, without locks
+  TripleBuffer<AudioSnapshot> audioSnapshots;
+
+  // three partials follow the tracked particle's position, three its
+  // velocity
+  OscillatorBank oscillators{6};
+  // sim -> audio thread, every event in order
+  SpscQueue<JerkEvent> jerkEvents{1024};
+  // one voice per top jerk rank, then a ring of voices for crossings
+  OscillatorBank eventVoices{2 * topJerks};
+  float crossingFreq[topJerks] = {};
+  float crossingAmp[topJerks] = {};
+  int nextCrossing = 0;
+
+  int numParticles = 1000;
+  PhysarumSim sim;
+
+  // primary only: this step's positions, and every particle in wire form
+  vector<Vec3f> positions;
+  vector<PackedParticle> packed;
+  int nextChunk = 0;
+
+  // what this node draws; on replicas the state chunks are copied in as is
+  PackedPointBuffer points;
+  SnapshotHistory history;
+  vector<float> chunkBlend;
+
+  double simTime = 0;
+  double stepDue = 0; // time owed to the simulation
 
   void initSpeakers()
   {
@@ -85,11 +178,32 @@ struct MyApp : DistributedAppWithState<CommonState>
     }
     spatializer = new Lbap(speakerLayout);
     spatializer->compile();
+
+    vector<float> x, y, z;
+    for (auto &speaker : speakerLayout)
+    {
+      Vec3d v = speaker.vec();
+      x.push_back(v.x);
+      y.push_back(v.y);
+      z.push_back(v.z);
+    }
+    batchPanner.setSpeakers(x, y, z);
+    batchPanner.resizeSources(1 + numClusters);
+    speakerOut.resize(speakerLayout.size());
+    sourceIn.resize(1 + numClusters);
+
+    int frames = audioIO().framesPerBuffer();
+    clusterAudio.assign(numClusters, vector<float>(frames));
+    unusedOut.resize(frames);
   }
 
   void onInit() override
   {
     audioIO().channelsBus(1);
+    oscillators.sampleRate(audioIO().framesPerSecond());
+    oscillators.reserveFrames(audioIO().framesPerBuffer());
+    eventVoices.sampleRate(audioIO().framesPerSecond());
+    eventVoices.reserveFrames(audioIO().framesPerBuffer());
     initSpeakers();
     initSpatializer();
 
@@ -104,6 +218,9 @@ struct MyApp : DistributedAppWithState<CommonState>
     }
     if (isPrimary())
     {
+      cout << "state packet: " << sizeof(CommonState) << " bytes, "
+           << chunkSize << " particles" << endl;
+
       auto guiDomain = GUIDomain::enableGUI(defaultWindowDomain());
       auto &gui = guiDomain->newGUI();
 
@@ -114,191 +231,361 @@ struct MyApp : DistributedAppWithState<CommonState>
       gui.add(sphereK);
       gui.add(minDist);
       gui.add(moveRate);
+      gui.add(worldScale);
+      neighborMode.setElements({"grid", "brute force", "validate"});
+      gui.add(neighborMode);
+      stepMode.setElements({"serial", "double buffered"});
+      gui.add(stepMode);
+      kernel.setElements({"scalar", "batched"});
+      kernel.set(SCALAR);
+      gui.add(kernel);
+      steering.setElements({"turn each", "accumulate"});
+      gui.add(steering);
+      gui.add(numThreads);
+      gui.add(simRate);
+      panner.setElements({"lbap", "clusters"});
+      gui.add(panner);
+      gui.add(jerkThreshold);
     }
   }
   void onCreate() override
   {
 
     // compile shaders
-    pointShader.compile(slurp("../point-vertex.glsl"),
+    pointShader.compile(slurp("../packed-vertex.glsl"),
                         slurp("../point-fragment.glsl"),
                         slurp("../point-geometry.glsl"));
 
-    mesh.primitive(Mesh::POINTS);
-
     if (isPrimary())
     {
+      sim.rules.worldScale = worldScale.get();
+      sim.resize(numParticles);
+      sim.scatter(random_device()());
+      positions.resize(numParticles);
+      packed.resize(numParticles);
+      resizePoints(numParticles);
+
       for (int i = 0; i < numParticles; i++)
       {
+        positions[i] = position(i);
+      }
+      packParticles();
 
-        Nav &p = particles[i];
-        Vec3f newPos = randomVec3f(3);
-        p.pos(newPos);
-        p.faceToward(randomVec3f(1), 1);
-        state().positions[i] = p.pos();
+      nav().pos(0, 0, 10 * worldScale.get());
+    }
+  }
 
-        oldPos[i] = newPos;
-        vel[i] = 0;
-        oldVel[i] = 0;
-        acc[i] = 0;
-        oldAcc[i] = 0;
+  int chunkCount(int n) { return (n + chunkSize - 1) / chunkSize; }
 
-        HSV randC = HSV(rnd::uniform(), 1.0f, 1.0f);
-        state().colors[i] = randC;
-      }
+  void resizePoints(int n)
+  {
+    points.resize(n);
+    history.resize(chunkCount(n));
+  }
 
-      nav().pos(0, 0, 10);
+  // Encodes every particle for the wire and hands them to the GPU as the
+  // snapshot for simTime.
+  void packParticles()
+  {
+    const aligned_vector<float> &hue = sim.particles.hue;
+    for (int i = 0; i < numParticles; i++)
+    {
+      const Vec3f &p = positions[i];
+      packed[i] = encodeParticle(p.x, p.y, p.z, hue[i]);
     }
+    double now = seconds();
+    for (int c = 0; c < history.size(); c++)
+    {
+      int begin = c * chunkSize;
+      int slot = history.receive(c, simTime, now);
+      points.write(slot, begin, packed.data() + begin, chunkSize);
+    }
+  }
 
-    for (int i = 0; i < numParticles; i++)
+  // Copies the next chunk of the particles into the state.
+  void packChunk()
+  {
+    int numChunks = (numParticles + chunkSize - 1) / chunkSize;
+    int chunk = nextChunk % numChunks;
+    nextChunk = chunk + 1;
+
+    int begin = chunk * chunkSize;
+    int count = min(chunkSize, numParticles - begin);
+    state().numParticles = numParticles;
+    state().chunk = chunk;
+    state().simTime = simTime;
+    copy(packed.begin() + begin, packed.begin() + begin + count,
+         state().packed);
+  }
+
+  // Copies the chunk in the state into the vertex buffer, following any
+  // change in the particle count. Nothing is decoded on the CPU.
+  void unpackChunk()
+  {
+    int n = state().numParticles;
+    if (n < 0)
+    {
+      return;
+    }
+    if (n != points.size())
+    {
+      resizePoints(n);
+    }
+
+    int begin = state().chunk * chunkSize;
+    if (state().chunk < 0 || begin >= n)
+    {
+      return;
+    }
+    int count = min(chunkSize, n - begin);
+    int slot = history.receive(state().chunk, state().simTime, seconds());
+    if (slot >= 0)
     {
-      mesh.vertex(state().positions[i]);
-      HSV col = state().colors[i];
-      mesh.color(col);
-      mesh.texCoord(1.0, 0);
+      points.write(slot, begin, state().packed, count);
+    }
+  }
+
+  Vec3f position(int i)
+  {
+    Float3 p = sim.position(i);
+    return Vec3f(p.x, p.y, p.z);
+  }
+
+  void reportMismatches(int mismatches)
+  {
+    if (mismatches > 0)
+    {
+      cerr << "grid mismatch: " << mismatches
+           << " neighbor lists differ from brute force" << endl;
     }
   }
 
   double phase = 0;
 
+  // One step of the simulation and everything that follows from it: the
+  // particles on the GPU, and the sound.
+  void stepSimulation()
+  {
+    sim.rules = {sight.get(), turnRate.get(), randTurn.get(), sphereK.get(),
+                 minDist.get(), moveRate.get(), worldScale.get(),
+                 neighborMode.get(), stepMode.get(), kernel.get(),
+                 steering.get()};
+    sim.threads(numThreads.get());
+    reportMismatches(sim.step());
+    for (int i = 0; i < numParticles; i++)
+    {
+      positions[i] = position(i);
+    }
+
+    sim.detectJerks(jerkThreshold.get());
+    queueJerkEvents();
+    int maxIndex = sim.topJerk.index[0];
+    float maxJerk = sim.topJerk.value[0];
+
+    if (maxJerk > 7e-7)
+    {
+      Vec3f maxPos = position(maxIndex) * 10;
+      soundPos.faceToward(maxPos, .125);
+      sim.particles.hue[maxIndex] += 0.125;
+      maxDex = maxIndex;
+    }
+    packParticles();
+
+    if (soundPos.pos().mag() > 20)
+    {
+      soundPos.faceToward(Vec3f(0, 0, 0), .012);
+    }
+
+    Vec3f normPos = soundPos.pos();
+    normPos.normalize();
+    if (soundPos.pos().mag() < (normPos.mag() * 10))
+    {
+      soundPos.pos() = normPos * 10;
+    }
+
+    soundPos.moveF(.25);
+    soundPos.step();
+
+    AudioSnapshot &snapshot = audioSnapshots.writeBuffer();
+    const PhysarumParticles &ps = sim.particles;
+    snapshot.trackedPos = position(maxDex);
+    snapshot.trackedVel = Vec3f(ps.vx[maxDex], ps.vy[maxDex], ps.vz[maxDex]);
+    snapshot.soundPos = soundPos.pos();
+    measureClusters(snapshot);
+    audioSnapshots.publish();
+  }
+
   void onAnimate(double dt) override
   {
     if (isPrimary())
     {
       phase += dt;
-      int maxIndex = 0;
-      float maxJerk = 0;
-      for (int i = 0; i < numParticles; i++)
-      {
-
-        Nav &p = particles[i];
-        oldPos[i] = p.pos();
-        oldVel[i] = vel[i];
-        oldAcc[i] = acc[i];
-
-        Vec3f spher = p.pos();
-        spher.normalize();
-        Vec3f SD = spher * 3 - p.pos();
-        float sd = SD.mag();
-        Vec3f sphAtt = p.uf() + SD;
-        if (sd > .25)
-        {
-          p.faceToward(p.pos() + p.uf() + sphAtt, sphereK);
-        }
-
-        if (p.pos().mag() > 5)
-        {
-          p.faceToward(Vec3f(0), .15);
-        }
-        for (int j = 0; j < numParticles; j++)
-        {
-          Nav &p2 = particles[j];
-          HSV h1 = state().colors[i];
-          HSV h2 = state().colors[j];
-
-          if (i != j)
-          {
-            Vec3f D = p2.pos() - p.pos();
-            float d = D.mag();
-            D.normalize();
-            bool viewCheck = (D.x * p.uf().x + D.y * p.uf().y + D.z * p.uf().z) >= 0;
-            float hueDif = sin(M_PI_2 * (h2.h - h1.h));
-            bool hueCheck = abs(hueDif) > .2;
-            Vec3f dirRep = p.uf() - D;
-            Vec3f dirAtt = p.uf() + D;
-
-            if (d < sight && viewCheck && hueCheck && d > minDist)
-            {
-              p.faceToward(p.pos() + dirRep, turnRate);
-              state().colors[i].h += hueDif * .002;
-            }
-            if (d < sight && viewCheck && !hueCheck && d > minDist)
-            {
-              p.faceToward(p.pos() + dirAtt, turnRate);
-              state().colors[i].h += hueDif * .002;
-            }
-            if (d < minDist)
-            {
-              p.faceToward(p.pos() + dirRep, 1.);
-            }
-          }
-        }
-
-        vel[i] = p.pos() - oldPos[i];
-        acc[i] = vel[i] - oldVel[i];
-        Vec3f jerk = acc[i] - oldAcc[i];
-        float dif = jerk.mag() - maxJerk;
-        if (dif > 25e-8)
-        {
-          maxJerk = jerk.mag();
-          maxIndex = i;
-        }
-
-        state().positions[i] = p.pos();
-        Vec3f rand = randomVec3f(1);
-        rand.normalize();
-        p.faceToward(p.pos() + p.uf() + rand, randTurn);
-        p.moveF(moveRate);
-        p.step();
-
-        if (state().colors[i].h > 1.0)
-        {
-          state().colors[i].h -= 1.0;
-        }
-      }
       state().pointSize = pointSize;
-      if (maxJerk > 7e-7)
+
+      // Steps at simRate, whatever the frame rate. Drawing interpolates
+      // between steps, here and on replicas. If frames fall behind, the
+      // backlog is dropped rather than run in a burst.
+      double stepLength = 1.0 / simRate.get();
+      stepDue = min(stepDue + dt, 2 * stepLength);
+      if (stepDue >= stepLength)
       {
-        Vec3f maxPos = particles[maxIndex].pos() * 10;
-        soundPos.faceToward(maxPos, .125);
-        state().colors[maxIndex].h += 0.125;
-        maxDex = maxIndex;
+        stepDue -= stepLength;
+        simTime += stepLength;
+        stepSimulation();
       }
+      packChunk();
+    }
+    else
+    {
+      unpackChunk();
+    }
+  }
 
-      if (soundPos.pos().mag() > 20)
+  // Hands this step's top jerks, then its crossings, to onSound. If onSound
+  // falls behind, the rest of the step's crossings are lost.
+  void queueJerkEvents()
+  {
+    const TopK<topJerks> &top = sim.topJerk;
+    for (int k = 0; k < top.count; k++)
+    {
+      int i = top.index[k];
+      jerkEvents.push({i, k, top.value[k], sim.particles.hue[i]});
+    }
+    for (int i : sim.crossings)
+    {
+      if (!jerkEvents.push({i, -1, sim.jerkMag[i], sim.particles.hue[i]}))
       {
-        soundPos.faceToward(Vec3f(0, 0, 0), .012);
+        return;
       }
+    }
+  }
 
-      Vec3f normPos = soundPos.pos();
-      normPos.normalize();
-      if (soundPos.pos().mag() < (normPos.mag() * 10))
+  void measureClusters(AudioSnapshot &snapshot)
+  {
+    int count[numClusters] = {};
+    for (int c = 0; c < numClusters; c++)
+    {
+      snapshot.clusterPos[c] = Vec3f(0);
+    }
+    for (int i = 0; i < numParticles; i++)
+    {
+      float h = sim.particles.hue[i] - floor(sim.particles.hue[i]);
+      int c = min(numClusters - 1, (int)(h * numClusters));
+      snapshot.clusterPos[c] += positions[i];
+      count[c]++;
+    }
+    for (int c = 0; c < numClusters; c++)
+    {
+      if (count[c] > 0)
       {
-        soundPos.pos() = normPos * 10;
+        snapshot.clusterPos[c] /= count[c];
       }
+      snapshot.clusterLevel[c] = count[c] / (float)numParticles;
+    }
+  }
 
-      soundPos.moveF(.25);
-      soundPos.step();
+  // One sine per cluster, pitched by hue over two octaves and as loud as
+  // the cluster is big, all panned together with the tracked voice.
+  void renderClusters(AudioIOData &io, const AudioSnapshot &snapshot)
+  {
+    int frames = io.framesPerBuffer();
+    float invFrames = 1.0f / frames;
+    for (int c = 0; c < numClusters; c++)
+    {
+      float inc = 220 * pow(2.0f, 2.0f * c / numClusters) /
+                  io.framesPerSecond();
+      float amp = clusterAmp[c];
+      float target = 0.05f * sqrt(snapshot.clusterLevel[c]);
+      float dAmp = (target - amp) * invFrames;
+      float phase = clusterPhase[c];
+      float *out = clusterAudio[c].data();
+      for (int f = 0; f < frames; f++)
+      {
+        out[f] = (amp + dAmp * f) * sinCycle(phase);
+        phase += inc;
+        phase = phase >= 1 ? phase - 1 : phase;
+      }
+      clusterPhase[c] = phase;
+      clusterAmp[c] = target;
+      sourceIn[1 + c] = out;
+      batchPanner.setSource(1 + c, snapshot.clusterPos[c].x,
+                            snapshot.clusterPos[c].y,
+                            snapshot.clusterPos[c].z);
     }
+    sourceIn[0] = io.busBuffer(0);
+    batchPanner.setSource(0, snapshot.soundPos.x, snapshot.soundPos.y,
+                          snapshot.soundPos.z);
 
-    for (int i = 0; i < numParticles; i++)
+    for (int k = 0; k < (int)speakerLayout.size(); k++)
     {
-      mesh.vertices()[i] = state().positions[i];
+      int channel = speakerLayout[k].deviceChannel;
+      speakerOut[k] =
+          channel < io.channelsOut() ? io.outBuffer(channel) : unusedOut.data();
+    }
+    batchPanner.render(sourceIn.data(), speakerOut.data(), frames);
+  }
 
-      mesh.colors()[i] = state().colors[i];
+  // Top jerks hold a voice per rank, pitched by hue, until the next step
+  // replaces them; crossings take the next voice of the ring.
+  void hearJerk(const JerkEvent &event)
+  {
+    float hue = event.hue - floor(event.hue);
+    float freq = 330 * pow(2.0f, 2 * hue);
+    if (event.rank >= 0)
+    {
+      eventVoices.set(event.rank, freq, 0.02f / (1 + event.rank));
+    }
+    else
+    {
+      crossingFreq[nextCrossing] = 2 * freq;
+      crossingAmp[nextCrossing] = 0.03f;
+      nextCrossing = (nextCrossing + 1) % topJerks;
     }
   }
 
   void onSound(AudioIOData &io) override
   {
-    while (io())
+    // never blocks: at worst we hear the previous step again
+    audioSnapshots.update();
+    const AudioSnapshot &snapshot = audioSnapshots.read();
+    const Vec3f &pos = snapshot.trackedPos;
+    const Vec3f &vel = snapshot.trackedVel;
+
+    // Controls change once per block; the bank ramps across it. The
+    // velocity is one step's move (moveRate long), hence the scale.
+    oscillators.set(0, 27.5 + 10 * pos.x, 0.05);
+    oscillators.set(1, 55 + 10 * pos.y, 0.05);
+    oscillators.set(2, 137.5 + 10 * pos.z, 0.05);
+    oscillators.set(3, 192.5 + 1e3 * vel.x, 0.05);
+    oscillators.set(4, 96.25 + 1e3 * vel.y, 0.05);
+    oscillators.set(5, 178.75 + 1e3 * vel.z, 0.05);
+
+    JerkEvent event;
+    while (jerkEvents.pop(event))
+    {
+      hearJerk(event);
+    }
+    // crossings ring for a few blocks
+    for (int c = 0; c < topJerks; c++)
     {
+      crossingAmp[c] *= 0.6f;
+      eventVoices.set(topJerks + c, crossingFreq[c], crossingAmp[c]);
+    }
 
-      osc1.freq(27.5 + 10 * particles[maxDex].pos().x);
-      osc2.freq(55 + 10 * particles[maxDex].pos().y);
-      osc3.freq(137.5 + 10 * particles[maxDex].pos().z);
-      osc4.freq(192.5 + 1e8 * vel[maxDex].x);
-      osc5.freq(96.25 + 1e8 * vel[maxDex].y);
-      osc6.freq(178.75 + 1e8 * vel[maxDex].z);
+    float *bus = io.busBuffer(0);
+    fill_n(bus, io.framesPerBuffer(), 0.0f);
+    oscillators.render(bus, io.framesPerBuffer());
+    eventVoices.render(bus, io.framesPerBuffer());
 
-      float s = (osc1() + osc2() + osc3() + osc4() + osc5() + osc6()) * 0.05;
-      io.bus(0) = s;
+    if (panner.get() == CLUSTERS)
+    {
+      renderClusters(io, snapshot);
+      return;
     }
-    //    // Spatialize
 
     spatializer->prepare(io);
 
-    spatializer->renderBuffer(io, soundPos.pos(), io.busBuffer(0),
+    spatializer->renderBuffer(io, snapshot.soundPos, io.busBuffer(0),
                               io.framesPerBuffer());
     spatializer->finalize(io);
   }
@@ -311,29 +598,42 @@ struct MyApp : DistributedAppWithState<CommonState>
     g.shader(pointShader);
     float pSize = state().pointSize;
     g.shader().uniform("pointSize", pSize / 100);
+    g.shader().uniform("positionBound", positionBound);
+    g.shader().uniform("chunkSize", chunkSize);
+    chunkBlend.resize(2 * history.size());
+    history.blend(history.renderTime(seconds()), chunkBlend.data());
+    glUniform2fv(glGetUniformLocation(pointShader.id(), "chunkBlend"),
+                 history.size(), chunkBlend.data());
     g.lens().eyeSep(0);
     g.blending(true);
     g.blendTrans();
     g.depthTesting(true);
-    g.draw(mesh);
+    g.update();
+    points.draw();
   }
 
   bool onKeyDown(const Keyboard &k) override
   {
-    if (k.key() == '1')
+    if (k.key() == '1' && isPrimary())
     {
-
-      for (int i = 0; i < numParticles; i++)
-      {
-        state().colors[i].h = rnd::uniform();
-      }
+      sim.randomizeHues();
     }
   }
 };
 
-int main()
+// usage: ColorPhysarum [numParticles] [worldScale]  (only the primary
+// needs them). Without a worldScale, the world grows with the count so the
+// particles see as many neighbors as the default 1000 do.
+int main(int argc, char *argv[])
 {
   MyApp app;
+  if (argc > 1)
+  {
+    app.numParticles = min(max(1, atoi(argv[1])), maxChunks * chunkSize);
+  }
+  // set() clamps to the slider's range
+  app.worldScale.set(argc > 2 ? atof(argv[2])
+                              : sqrt(app.numParticles / 1000.0f));
   AudioDevice::printAll();
   // app.audioIO().deviceIn(AudioDevice("MacBook Pro Microphone"));
   // app.audioIO().deviceOut(AudioDevice("MacBook Pro Speakers"));
@@ -0,0 +1,186 @@
+#pragma once
+
+// GPU vertex buffer holding particles in their wire format.
+//
+// Each vertex is one PackedParticle, 8 bytes, read by packed-vertex.glsl
+// as a normalized ushort4: the shader decodes the position and turns the
+// hue into RGB. A state chunk can therefore be copied into the buffer as
+// is, with no per-particle work on the CPU. There are three slots, each a
+// full set of particles, so the shader can blend between a particle's
+// recent snapshots (see SnapshotHistory.hpp).
+//
+// With GL 4.4 the buffer is persistently and coherently mapped, so writes
+// land in GPU-visible memory directly. Before writing, write() waits for
+// the last draw to finish reading, using a fence. Older contexts (macOS
+// stops at 4.1) keep a CPU copy and upload only the written ranges with
+// glBufferSubData. The GL objects live as long as the context; there is
+// nothing to release by hand.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "al/graphics/al_OpenGL.hpp"
+#include "StateEncoding.hpp"
+
+class PackedPointBuffer
+{
+public:
+  int size() const { return count; }
+
+  static constexpr int slots = 3; // SnapshotHistory::slots
+
+  // Needs the GL context. Keeps the first min(n, old size) particles.
+  void resize(int n)
+  {
+    if (n > capacity)
+    {
+      allocate(std::max(n, capacity * 2));
+    }
+    count = n;
+  }
+
+  // Copies `n` particles to position `begin` of `slot`.
+  void write(int slot, int begin, const PackedParticle *src, int n)
+  {
+    n = std::min(n, count - begin);
+    if (begin < 0 || n <= 0)
+    {
+      return;
+    }
+    begin += slot * capacity;
+    if (mapped)
+    {
+      waitForDraw();
+      std::memcpy(mapped + begin, src, n * sizeof(PackedParticle));
+      return;
+    }
+    std::memcpy(staging.data() + begin, src, n * sizeof(PackedParticle));
+    dirtyBegin = std::min(dirtyBegin, begin);
+    dirtyEnd = std::max(dirtyEnd, begin + n);
+  }
+
+  // Draws all particles as points with whatever shader is bound; call
+  // g.update() first so it has this frame's matrices.
+  void draw()
+  {
+    if (count == 0)
+    {
+      return;
+    }
+    if (!mapped && dirtyBegin < dirtyEnd)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(PackedParticle),
+                      (dirtyEnd - dirtyBegin) * sizeof(PackedParticle),
+                      staging.data() + dirtyBegin);
+      dirtyBegin = slots * capacity;
+      dirtyEnd = 0;
+    }
+    glBindVertexArray(vao);
+    glDrawArrays(GL_POINTS, 0, count);
+    glBindVertexArray(0);
+    if (mapped)
+    {
+      if (fence)
+      {
+        glDeleteSync(fence);
+      }
+      fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+  }
+
+private:
+  void allocate(int n)
+  {
+    // the old contents, so a resize keeps what replicas already received
+    std::vector<PackedParticle> keep((size_t)slots * count);
+    const PackedParticle *old = mapped ? mapped : staging.data();
+    for (int s = 0; s < slots && count > 0; s++)
+    {
+      std::memcpy(keep.data() + s * count, old + s * capacity,
+                  count * sizeof(PackedParticle));
+    }
+    release();
+
+    capacity = n;
+    dirtyBegin = slots * n;
+    dirtyEnd = 0;
+    GLsizeiptr bytes = (GLsizeiptr)slots * n * sizeof(PackedParticle);
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (GLAD_GL_VERSION_4_4)
+    {
+      GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+      mapped = (PackedParticle *)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+                                                  flags);
+    }
+    if (!mapped)
+    {
+      glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+      staging.assign((size_t)slots * n, PackedParticle{});
+    }
+    // per slot: x, y, z, hue as one normalized vec4, like PackedParticle
+    for (int s = 0; s < slots; s++)
+    {
+      glEnableVertexAttribArray(s);
+      glVertexAttribPointer(
+          s, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedParticle),
+          (const void *)((size_t)s * n * sizeof(PackedParticle)));
+    }
+    glBindVertexArray(0);
+
+    int kept = (int)keep.size() / slots;
+    for (int s = 0; s < slots; s++)
+    {
+      write(s, 0, keep.data() + s * kept, kept);
+    }
+  }
+
+  void waitForDraw()
+  {
+    if (!fence)
+    {
+      return;
+    }
+    const GLuint64 timeout = 100000000; // 100 ms
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  void release()
+  {
+    if (fence)
+    {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+    if (mapped)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      mapped = nullptr;
+    }
+    if (vbo)
+    {
+      glDeleteBuffers(1, &vbo);
+      glDeleteVertexArrays(1, &vao);
+      vbo = vao = 0;
+    }
+    staging.clear();
+  }
+
+  GLuint vao = 0, vbo = 0;
+  int count = 0, capacity = 0;
+  PackedParticle *mapped = nullptr;
+  GLsync fence = nullptr;
+
+  // fallback without persistent mapping
+  std::vector<PackedParticle> staging;
+  int dirtyBegin = 0, dirtyEnd = 0;
+};
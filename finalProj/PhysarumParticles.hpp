@@ -0,0 +1,91 @@
+#pragma once
+
+// Structure-of-arrays storage for the ColorPhysarum agents.
+//
+// The agents only ever use a position and a forward vector, so instead of a
+// full Nav (pose and quaternion in doubles plus smoothing state) each one is
+// a handful of floats, one contiguous array per component. The neighbor
+// loop reads only x, y, z and hue, 16 bytes per neighbor; bulk passes such
+// as moveForward stream straight through and vectorize.
+
+#include <array>
+#include <cmath>
+
+#include "../common/AlignedAllocator.hpp"
+#include "../common/PoseBatch.hpp"
+
+struct PhysarumParticles
+{
+  // position
+  aligned_vector<float> x, y, z;
+  // unit forward vector
+  aligned_vector<float> fx, fy, fz;
+  aligned_vector<float> hue;
+  // last step's velocity and acceleration, for jerk tracking
+  aligned_vector<float> vx, vy, vz;
+  aligned_vector<float> ax, ay, az;
+
+  int size() const { return (int)x.size(); }
+
+  void resize(int n)
+  {
+    for (auto *a : {&x, &y, &z, &fx, &fy, &fz, &hue, &vx, &vy, &vz, &ax, &ay,
+                    &az})
+    {
+      a->assign(n, 0.0f);
+    }
+  }
+
+  std::array<float, 3> position(int i) const { return {x[i], y[i], z[i]}; }
+  std::array<float, 3> heading(int i) const { return {fx[i], fy[i], fz[i]}; }
+
+  void setPosition(int i, float px, float py, float pz)
+  {
+    x[i] = px;
+    y[i] = py;
+    z[i] = pz;
+  }
+
+  void setHeading(int i, float hx, float hy, float hz)
+  {
+    fx[i] = hx;
+    fy[i] = hy;
+    fz[i] = hz;
+  }
+
+  // Records this step's velocity (the move from `from` to the current
+  // position) and acceleration, given last step's in `prev`, which may be
+  // this same store. Returns the magnitude of the jerk.
+  float recordMotion(int i, const PhysarumParticles &prev, float fromX,
+                     float fromY, float fromZ)
+  {
+    float nvx = x[i] - fromX, nvy = y[i] - fromY, nvz = z[i] - fromZ;
+    float nax = nvx - prev.vx[i], nay = nvy - prev.vy[i],
+          naz = nvz - prev.vz[i];
+    float jx = nax - prev.ax[i], jy = nay - prev.ay[i], jz = naz - prev.az[i];
+    vx[i] = nvx;
+    vy[i] = nvy;
+    vz[i] = nvz;
+    ax[i] = nax;
+    ay[i] = nay;
+    az[i] = naz;
+    return std::sqrt(jx * jx + jy * jy + jz * jz);
+  }
+
+  // Moves every particle in [begin, end) `rate` along its heading.
+  void moveForward(float rate, int begin, int end)
+  {
+    float *__restrict px = x.data();
+    float *__restrict py = y.data();
+    float *__restrict pz = z.data();
+    const float *__restrict hx = fx.data();
+    const float *__restrict hy = fy.data();
+    const float *__restrict hz = fz.data();
+    for (int i = begin; i < end; i++)
+    {
+      px[i] += hx[i] * rate;
+      py[i] += hy[i] * rate;
+      pz[i] += hz[i] * rate;
+    }
+  }
+};
@@ -0,0 +1,858 @@
+#pragma once
+
+// The ColorPhysarum agent rules, without any GUI, audio, GL or allolib.
+//
+// The app sets `rules` from its parameters and calls step() once a frame;
+// the benchmark in bench/physarum.cpp does the same with fixed rules. Both
+// go through this class, so what gets profiled is what runs.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../common/FastMath.hpp"
+#include "../common/Philox.hpp"
+#include "../common/SpatialGrid.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../common/TopK.hpp"
+#include "PhysarumParticles.hpp"
+
+// Just enough of a 3-vector for the rules. Like al::Vec3f, normalize()
+// works in place.
+struct Float3
+{
+  float x = 0, y = 0, z = 0;
+
+  Float3() = default;
+  Float3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+  float operator[](int k) const { return k == 0 ? x : (k == 1 ? y : z); }
+
+  Float3 operator+(const Float3 &v) const { return {x + v.x, y + v.y, z + v.z}; }
+  Float3 operator-(const Float3 &v) const { return {x - v.x, y - v.y, z - v.z}; }
+  Float3 operator-() const { return {-x, -y, -z}; }
+  Float3 operator*(float s) const { return {x * s, y * s, z * s}; }
+
+  float dot(const Float3 &v) const { return x * v.x + y * v.y + z * v.z; }
+  float mag() const { return std::sqrt(dot(*this)); }
+
+  Float3 &normalize()
+  {
+    float m = mag();
+    if (m > 0)
+    {
+      x /= m;
+      y /= m;
+      z /= m;
+    }
+    return *this;
+  }
+};
+
+enum NeighborMode
+{
+  GRID,
+  BRUTE_FORCE,
+  VALIDATE // grid, checked against the brute force neighbor set
+};
+
+enum StepMode
+{
+  SERIAL,         // in place: later particles see earlier ones' updates
+  DOUBLE_BUFFERED // everyone reads last step, in parallel
+};
+
+enum InteractKernel
+{
+  SCALAR, // interact(), one neighbor at a time
+  BATCHED // interactBatched(), SIMD over neighbors
+};
+
+enum SteerMode
+{
+  TURN_EACH, // one slerp per rule that fires, in order
+  ACCUMULATE // sum the rules' targets, one slerp per particle
+};
+
+// Parameter values for one step. Read once so every thread sees the same
+// numbers even if the GUI moves a slider mid-step.
+struct Rules
+{
+  float sight = 0.45f;
+  float turnRate = 0.35f;
+  float randTurn = 0.01f;
+  float sphereK = 0.14f;
+  float minDist = 0.02f;
+  float moveRate = 0.055f;
+  // Sizes the world: the shell the particles keep to and the wall behind
+  // it are this many times their default radii of 3 and 5. The particles
+  // spread over the shell, so n of them at scale sqrt(n / 1000) see as
+  // many neighbors as 1000 do at scale 1.
+  float worldScale = 1;
+  int neighborMode = GRID;
+  int stepMode = DOUBLE_BUFFERED;
+  int kernel = SCALAR;
+  int steerMode = TURN_EACH;
+};
+
+// Collects the turns one particle makes in a step. With TURN_EACH every
+// toward() turns f at once, as the original rules did. With ACCUMULATE f
+// is left alone and each target is summed, weighted by its amount; finish()
+// then makes one turn toward the weighted mean by 1 - prod(1 - amt). That
+// amount is exact when the turns all point the same way, but the mean of
+// targets that disagree sits much closer to f than turn after turn would
+// take it. So the mean's part across f is first stretched by
+// sqrt(1 + sum(amt) / 2), fitted so the swarm turns as much per step as
+// with TURN_EACH (bench/steering.cpp); without it, it turns half as much.
+// That keeps the old feel of turnRate and sphereK.
+struct Steering
+{
+  bool accumulate = false;
+  Float3 sum;
+  float weight = 0;
+  float keep = 1; // fraction of the angle the turns so far would leave
+
+  explicit Steering(int mode) : accumulate(mode == ACCUMULATE) {}
+
+  void toward(Float3 &f, const Float3 &dir, float amt, bool fast = false)
+  {
+    if (!accumulate)
+    {
+      if (fast)
+      {
+        turnToward<true>(f.x, f.y, f.z, dir.x, dir.y, dir.z, amt);
+      }
+      else
+      {
+        turnToward(f.x, f.y, f.z, dir.x, dir.y, dir.z, amt);
+      }
+      return;
+    }
+    Float3 t = dir;
+    t.normalize();
+    sum = sum + t * amt;
+    weight += amt;
+    keep *= 1 - amt;
+  }
+
+  // what finish() turns f toward, by 1 - keep
+  Float3 target(const Float3 &f) const
+  {
+    float along = f.dot(sum);
+    Float3 across = sum - f * along;
+    return f * along + across * std::sqrt(1 + weight / 2);
+  }
+
+  void finish(Float3 &f) const
+  {
+    if (accumulate && weight > 0)
+    {
+      Float3 t = target(f);
+      turnToward(f.x, f.y, f.z, t.x, t.y, t.z, 1 - keep);
+    }
+  }
+};
+
+class PhysarumSim
+{
+public:
+  // jerkiest particles reported by detectJerks()
+  static constexpr int topJerks = 8;
+
+  // particles are pulled back once they pass radius 5 (times worldScale),
+  // so this box holds nearly all of them; the rest land in the border cells
+  static constexpr float gridExtent = 6;
+
+  Rules rules;
+  PhysarumParticles particles;
+  std::vector<float> jerkMag; // this step's, per particle
+
+  // results of detectJerks()
+  TopK<topJerks> topJerk;
+  std::vector<int> crossings; // ascending
+
+  int size() const { return numParticles; }
+
+  void resize(int n)
+  {
+    numParticles = n;
+    for (auto *a : {&randX, &randY, &randZ})
+    {
+      a->resize(n);
+    }
+    particles.resize(n);
+    nextParticles.resize(n);
+    jerkMag.assign(n, 0.0f);
+    lastJerk.assign(n, 0.0f);
+  }
+
+  // Random positions in the cube of half-width 3 times rules.worldScale,
+  // each facing a random point near the origin, with random hues. `seed`
+  // also keys the random turns of every later step, so it alone determines
+  // the run.
+  void scatter(uint64_t seed)
+  {
+    this->seed = seed;
+    Philox start(seed, 1);
+    for (int i = 0; i < numParticles; i++)
+    {
+      auto p = start.uniformS3(i, 0, 0), t = start.uniformS3(i, 0, 1);
+      Float3 pos = Float3(p[0], p[1], p[2]) * (3 * rules.worldScale);
+      Float3 f = (Float3(t[0], t[1], t[2]) - pos).normalize();
+      particles.setPosition(i, pos.x, pos.y, pos.z);
+      particles.setHeading(i, f.x, f.y, f.z);
+      particles.hue[i] = start.uniform(i, 0, 2);
+    }
+  }
+
+  // New random hues for every particle, drawn for the current step.
+  void randomizeHues()
+  {
+    Philox hues(seed, 2);
+    hues.uniform(numParticles, 0, stepCount, particles.hue.data());
+  }
+
+  // threads counts the calling one; 0 means one per hardware thread
+  void threads(int n)
+  {
+    if (!pool || (n > 0 && pool->size() != n))
+    {
+      pool.reset(new ThreadPool(n));
+    }
+  }
+
+  Float3 position(int i) const { return position(particles, i); }
+  Float3 heading(int i) const { return heading(particles, i); }
+
+  // Advances every particle once. Returns how many neighbor lists differ
+  // from brute force, which is only checked in VALIDATE mode.
+  int step()
+  {
+    threads(0);
+
+    // interact() does nothing past this distance
+    float reach = std::max(rules.sight, rules.minDist);
+    // in the serial step, particles earlier in the loop have already
+    // moved, so the grid has to look one move further than `reach`
+    float queryRadius = reach + rules.moveRate + 1e-4f;
+    if (rules.neighborMode != BRUTE_FORCE)
+    {
+      grid.configure(gridExtent * rules.worldScale, queryRadius);
+      grid.build(numParticles, [&](int k)
+                 { return particles.position(k); });
+    }
+    // The buffered step reads positions and hues that stay put for the
+    // whole step, so the batched kernel can read them in cell order.
+    cellOrdered = rules.kernel == BATCHED && rules.neighborMode == GRID &&
+                  rules.stepMode == DOUBLE_BUFFERED;
+    if (cellOrdered)
+    {
+      for (auto *a : {&cellX, &cellY, &cellZ, &cellHue})
+      {
+        a->resize(numParticles);
+      }
+      for (int k = 0; k < numParticles; k++)
+      {
+        int j = grid.sorted[k];
+        cellX[k] = particles.x[j];
+        cellY[k] = particles.y[j];
+        cellZ[k] = particles.z[j];
+        cellHue[k] = particles.hue[j];
+      }
+    }
+
+    int mismatches;
+    if (rules.stepMode == DOUBLE_BUFFERED)
+    {
+      mismatches = stepBuffered(reach, queryRadius);
+    }
+    else
+    {
+      mismatches = stepSerial(reach, queryRadius);
+    }
+    stepCount++;
+    return mismatches;
+  }
+
+  // Finds this step's top jerks, and the particles whose jerk rose past
+  // `threshold`. Each grain-sized piece of the particles reduces into its
+  // own slot; only the small partial results are merged serially.
+  void detectJerks(float threshold)
+  {
+    threads(0);
+    const int grain = 2048;
+    int parts = (numParticles + grain - 1) / grain;
+    jerkParts.resize(parts);
+    crossingParts.resize(parts);
+
+    // a range may span several pieces (one thread runs them all at once),
+    // so every piece's slot is refilled whatever the ranges were
+    auto scanRange = [&](int begin, int end)
+    {
+      for (int p = begin; p < end; p += grain)
+      {
+        TopK<topJerks> &top = jerkParts[p / grain];
+        std::vector<int> &crossed = crossingParts[p / grain];
+        top.clear();
+        crossed.clear();
+        for (int i = p; i < std::min(p + grain, end); i++)
+        {
+          float jerk = jerkMag[i];
+          top.offer(jerk, i);
+          if (jerk > threshold && lastJerk[i] <= threshold)
+          {
+            crossed.push_back(i);
+          }
+          lastJerk[i] = jerk;
+        }
+      }
+    };
+    pool->parallelFor(numParticles, grain, scanRange);
+
+    topJerk.clear();
+    crossings.clear();
+    for (int p = 0; p < parts; p++)
+    {
+      topJerk.merge(jerkParts[p]);
+      crossings.insert(crossings.end(), crossingParts[p].begin(),
+                       crossingParts[p].end());
+    }
+  }
+
+private:
+  static Float3 position(const PhysarumParticles &ps, int i)
+  {
+    return Float3(ps.x[i], ps.y[i], ps.z[i]);
+  }
+
+  static Float3 heading(const PhysarumParticles &ps, int i)
+  {
+    return Float3(ps.fx[i], ps.fy[i], ps.fz[i]);
+  }
+
+  // Keeps a particle at pos, facing f, near the shell of radius 3 and
+  // inside radius 5, both times worldScale.
+  void steerToShell(const Float3 &pos, Float3 &f, Steering &steer) const
+  {
+    Float3 spher = pos;
+    spher.normalize();
+    Float3 SD = spher * (3 * rules.worldScale) - pos;
+    float sd = SD.mag();
+    Float3 sphAtt = f + SD;
+    if (sd > .25)
+    {
+      steer.toward(f, f + sphAtt, rules.sphereK);
+    }
+
+    if (pos.mag() > 5 * rules.worldScale)
+    {
+      steer.toward(f, -pos, .15);
+    }
+  }
+
+  // One pair of the agent rules: a particle at pos, facing f, with hue
+  // myHue, reacts to a neighbor at `other`. Each call may change f, so
+  // neighbors have to be visited in index order for a repeatable result.
+  void interact(const Float3 &pos, Float3 &f, float myHue, float &hue,
+                const Float3 &other, float otherHue, Steering &steer) const
+  {
+    Float3 D = other - pos;
+    float d = D.mag();
+    D.normalize();
+    bool viewCheck = D.dot(f) >= 0;
+    float hueDif = std::sin(M_PI_2 * (otherHue - myHue));
+    bool hueCheck = std::fabs(hueDif) > .2;
+    Float3 dirRep = f - D;
+    Float3 dirAtt = f + D;
+
+    if (d < rules.sight && viewCheck && hueCheck && d > rules.minDist)
+    {
+      steer.toward(f, dirRep, rules.turnRate);
+      hue += hueDif * .002;
+    }
+    if (d < rules.sight && viewCheck && !hueCheck && d > rules.minDist)
+    {
+      steer.toward(f, dirAtt, rules.turnRate);
+      hue += hueDif * .002;
+    }
+    if (d < rules.minDist)
+    {
+      steer.toward(f, dirRep, 1.);
+    }
+  }
+
+  // neighbor lists are padded to this many, a whole number of vectors
+  static constexpr int batch = 16;
+
+  enum PairRule
+  {
+    NO_RULE,
+    REPEL,   // in sight, other hue: turn away
+    ATTRACT, // in sight, similar hue: turn toward
+    TOO_CLOSE
+  };
+
+  // Per thread scratch for interactBatched(), padded to whole batches
+  struct NeighborBatch
+  {
+    std::vector<int> index;             // candidates, in any order
+    std::vector<int> hits;              // positions in index that turn
+    aligned_vector<float> x, y, z, hue; // gathered candidates
+    aligned_vector<float> dx, dy, dz;   // unit direction to each
+    aligned_vector<float> hueDif;
+    aligned_vector<int> rule;
+  };
+
+  // The SIMD part of interactBatched(): direction, hue term and rule for
+  // n neighbors. A function of its own because restrict is only honored on
+  // parameters once this is inlined; without it the alias checks stop the
+  // vectorizer.
+  static void classifyPairs(int n, const Float3 &pos, float myHue,
+                            float sight, float minDist,
+                            const float *__restrict x,
+                            const float *__restrict y,
+                            const float *__restrict z,
+                            const float *__restrict hue,
+                            float *__restrict dx, float *__restrict dy,
+                            float *__restrict dz, float *__restrict hueDif,
+                            int *__restrict rule)
+  {
+    const float px = pos.x, py = pos.y, pz = pos.z;
+    for (int k = 0; k < n; k++)
+    {
+      float ddx = x[k] - px, ddy = y[k] - py, ddz = z[k] - pz;
+      float d2 = ddx * ddx + ddy * ddy + ddz * ddz;
+      float inv = rsqrt(d2);
+      float d = d2 * inv;
+      dx[k] = ddx * inv;
+      dy[k] = ddy * inv;
+      dz[k] = ddz * inv;
+      // sin(pi/2 x) is sin(2 pi x/4)
+      float h = sinCycles(0.25f * (hue[k] - myHue));
+      hueDif[k] = h;
+      // selects only, no && or ifs, so the loop stays branch free
+      int r = std::fabs(h) > 0.2f ? REPEL : ATTRACT;
+      r = d < sight ? r : NO_RULE;
+      r = d > minDist ? r : NO_RULE;
+      rule[k] = d < minDist ? TOO_CLOSE : r;
+    }
+  }
+
+  // Room for n candidates, rounded up to whole batches
+  static void reserve(NeighborBatch &b, int n)
+  {
+    int padded = (n + batch - 1) / batch * batch;
+    if ((int)b.x.size() < padded)
+    {
+      for (auto *a : {&b.x, &b.y, &b.z, &b.hue, &b.dx, &b.dy, &b.dz,
+                      &b.hueDif})
+      {
+        a->resize(padded);
+      }
+      b.rule.resize(padded);
+    }
+  }
+
+  // Reads the candidates in b.index from `particles`.
+  void gatherCandidates(NeighborBatch &b) const
+  {
+    int n = (int)b.index.size();
+    reserve(b, n);
+    for (int k = 0; k < n; k++)
+    {
+      int j = b.index[k];
+      b.x[k] = particles.x[j];
+      b.y[k] = particles.y[j];
+      b.z[k] = particles.z[j];
+      b.hue[k] = particles.hue[j];
+    }
+  }
+
+  // Every particle in the grid cells within queryRadius of pos. Unsorted,
+  // and including particles out of reach: the kernel's SIMD pass is a
+  // cheaper place to drop those than a scalar test here. From the cell
+  // ordered copy (cellX...) when there is one, so each row of cells is one
+  // contiguous copy instead of a gather.
+  void collectCandidates(const Float3 &pos, float queryRadius,
+                         NeighborBatch &b) const
+  {
+    b.index.clear();
+    auto addRange = [&](int begin, int end)
+    {
+      b.index.insert(b.index.end(), grid.sorted.begin() + begin,
+                     grid.sorted.begin() + end);
+    };
+    grid.forEachRange(pos, queryRadius, addRange);
+    if (!cellOrdered)
+    {
+      gatherCandidates(b);
+      return;
+    }
+
+    reserve(b, (int)b.index.size());
+    int n = 0;
+    auto copyRange = [&](int begin, int end)
+    {
+      int count = end - begin;
+      std::copy_n(&cellX[begin], count, &b.x[n]);
+      std::copy_n(&cellY[begin], count, &b.y[n]);
+      std::copy_n(&cellZ[begin], count, &b.z[n]);
+      std::copy_n(&cellHue[begin], count, &b.hue[n]);
+      n += count;
+    };
+    grid.forEachRange(pos, queryRadius, copyRange);
+  }
+
+  // interact() for every candidate in b.index (read into b.x... already)
+  // except particle `self`, in ascending index order like the scalar path.
+  // Everything that does not depend on f (distance, direction, the hue term
+  // and so which rule applies) is worked out `batch` candidates at a time
+  // with masks instead of branches. Only the turns, each of which depends
+  // on the last, are made one by one, and only for pairs that turn at all.
+  // Those use the libm-free turnToward, and with an accumulating `steer`
+  // they are only summed, in whatever order the candidates came.
+  //
+  // The hue term uses sinCycles, within 3.6e-6 of libm's sine, and
+  // distances rsqrt, within 1.5e-7 relative, so a pair can only take
+  // another rule than interact() would if its |hueDif| is that close to
+  // the 0.2 cutoff or its distance to sight or minDist. In the serial step
+  // (ownHueMoves) a particle's own hue changes as it goes; pairs after such
+  // a change get their hue term recomputed.
+  void interactBatched(int self, const Float3 &pos, Float3 &f, float myHue,
+                       float &hue, bool ownHueMoves, NeighborBatch &b,
+                       Steering &steer) const
+  {
+    int n = (int)b.index.size();
+    int padded = (n + batch - 1) / batch * batch;
+
+    // lanes past n hold stale values; their results are never read
+    classifyPairs(padded, pos, myHue, rules.sight, rules.minDist, b.x.data(),
+                  b.y.data(), b.z.data(), b.hue.data(), b.dx.data(),
+                  b.dy.data(), b.dz.data(), b.hueDif.data(), b.rule.data());
+
+    b.hits.clear();
+    for (int k = 0; k < n; k++)
+    {
+      if (b.rule[k] != NO_RULE && b.index[k] != self)
+      {
+        b.hits.push_back(k);
+      }
+    }
+    if (!steer.accumulate || ownHueMoves)
+    {
+      auto byIndex = [&](int p, int q)
+      { return b.index[p] < b.index[q]; };
+      std::sort(b.hits.begin(), b.hits.end(), byIndex);
+    }
+
+    for (int k : b.hits)
+    {
+      int rule = b.rule[k];
+      Float3 D(b.dx[k], b.dy[k], b.dz[k]);
+      if (rule == TOO_CLOSE)
+      {
+        steer.toward(f, f - D, 1., true);
+        continue;
+      }
+      if (D.dot(f) < 0)
+      {
+        continue; // behind
+      }
+      float h = b.hueDif[k];
+      if (ownHueMoves && hue != myHue)
+      {
+        h = sinCycles(0.25f * (b.hue[k] - hue));
+        rule = std::fabs(h) > 0.2f ? REPEL : ATTRACT;
+      }
+      steer.toward(f, rule == REPEL ? f - D : f + D, rules.turnRate, true);
+      hue += h * .002;
+    }
+  }
+
+  // Everything within `reach` of particle i, in ascending index order so
+  // the result matches the brute force loop exactly.
+  void findNeighbors(int i, float reach, float queryRadius,
+                     std::vector<int> &out) const
+  {
+    out.clear();
+    Float3 pos = position(particles, i);
+    auto visit = [&](int j)
+    {
+      Float3 D = position(particles, j) - pos;
+      if (j != i && D.mag() < reach)
+      {
+        out.push_back(j);
+      }
+    };
+    grid.forEachCandidate(pos, queryRadius, visit);
+    std::sort(out.begin(), out.end());
+  }
+
+  // true if `found` is what a scan over all particles gives
+  bool validateNeighbors(int i, float reach,
+                         const std::vector<int> &found) const
+  {
+    std::vector<int> brute;
+    Float3 pos = position(particles, i);
+    for (int j = 0; j < numParticles; j++)
+    {
+      Float3 D = position(particles, j) - pos;
+      if (j != i && D.mag() < reach)
+      {
+        brute.push_back(j);
+      }
+    }
+    return brute == found;
+  }
+
+  // The original update: particles change in place, in index order.
+  int stepSerial(float reach, float queryRadius)
+  {
+    int mismatches = 0;
+    drawTurns(0, numParticles);
+    for (int i = 0; i < numParticles; i++)
+    {
+      Float3 pos = position(particles, i);
+      Float3 f = heading(particles, i);
+
+      Steering steer(rules.steerMode);
+      steerToShell(pos, f, steer);
+
+      float &hue = particles.hue[i];
+      if (rules.neighborMode == BRUTE_FORCE)
+      {
+        for (int j = 0; j < numParticles; j++)
+        {
+          if (j != i)
+          {
+            interact(pos, f, hue, hue, position(particles, j),
+                     particles.hue[j], steer);
+          }
+        }
+      }
+      else if (rules.kernel == BATCHED && rules.neighborMode == GRID)
+      {
+        collectCandidates(pos, queryRadius, serialBatch);
+        interactBatched(i, pos, f, hue, hue, true, serialBatch, steer);
+      }
+      else
+      {
+        findNeighbors(i, reach, queryRadius, neighbors);
+        if (rules.neighborMode == VALIDATE &&
+            !validateNeighbors(i, reach, neighbors))
+        {
+          mismatches++;
+        }
+        if (rules.kernel == BATCHED)
+        {
+          serialBatch.index = neighbors;
+          gatherCandidates(serialBatch);
+          interactBatched(i, pos, f, hue, hue, true, serialBatch, steer);
+        }
+        else
+        {
+          for (int j : neighbors)
+          {
+            interact(pos, f, hue, hue, position(particles, j),
+                     particles.hue[j], steer);
+          }
+        }
+      }
+
+      Float3 rand = randomTurn(i);
+      steer.toward(f, f + rand, rules.randTurn);
+      steer.finish(f);
+
+      Float3 newPos = pos + f * rules.moveRate;
+      particles.setPosition(i, newPos.x, newPos.y, newPos.z);
+      particles.setHeading(i, f.x, f.y, f.z);
+
+      jerkMag[i] = particles.recordMotion(i, particles, pos.x, pos.y, pos.z);
+
+      if (hue > 1.0)
+      {
+        hue -= 1.0;
+      }
+    }
+    return mismatches;
+  }
+
+  // Particle i of the double buffered step, all but the move, which
+  // moveBuffered() makes for the whole range. Reads only the front buffer
+  // (particles) and writes only index i of the back one.
+  void updateBuffered(int i, float reach, float queryRadius,
+                      std::vector<int> &found, NeighborBatch &batch,
+                      std::atomic<int> &mismatches)
+  {
+    Float3 pos = position(particles, i);
+    Float3 f = heading(particles, i);
+    const float myHue = particles.hue[i];
+    float hue = myHue;
+
+    Steering steer(rules.steerMode);
+    steerToShell(pos, f, steer);
+
+    if (rules.neighborMode == BRUTE_FORCE)
+    {
+      for (int j = 0; j < numParticles; j++)
+      {
+        if (j != i)
+        {
+          interact(pos, f, myHue, hue, position(particles, j),
+                   particles.hue[j], steer);
+        }
+      }
+    }
+    else if (rules.kernel == BATCHED && rules.neighborMode == GRID)
+    {
+      collectCandidates(pos, queryRadius, batch);
+      interactBatched(i, pos, f, myHue, hue, false, batch, steer);
+    }
+    else
+    {
+      findNeighbors(i, reach, queryRadius, found);
+      if (rules.neighborMode == VALIDATE &&
+          !validateNeighbors(i, reach, found))
+      {
+        mismatches++;
+      }
+      if (rules.kernel == BATCHED)
+      {
+        batch.index = found;
+        gatherCandidates(batch);
+        interactBatched(i, pos, f, myHue, hue, false, batch, steer);
+      }
+      else
+      {
+        for (int j : found)
+        {
+          interact(pos, f, myHue, hue, position(particles, j),
+                   particles.hue[j], steer);
+        }
+      }
+    }
+
+    Float3 rand = randomTurn(i);
+    steer.toward(f, f + rand, rules.randTurn);
+
+    if (hue > 1.0)
+    {
+      hue -= 1.0;
+    }
+
+    PhysarumParticles &next = nextParticles;
+    next.setHeading(i, f.x, f.y, f.z);
+    next.hue[i] = hue;
+    if (steer.accumulate)
+    {
+      // left for turnTowardBatch() over the whole range
+      Float3 t = steer.target(f);
+      turnX[i] = t.x;
+      turnY[i] = t.y;
+      turnZ[i] = t.z;
+      turnAmt[i] = steer.weight > 0 ? 1 - steer.keep : 0;
+    }
+  }
+
+  // Moves particles [begin, end) of the back buffer along their new
+  // headings. No one reads the back buffer's positions during the step, so
+  // this can wait for the whole range and stream through it.
+  void moveBuffered(int begin, int end)
+  {
+    PhysarumParticles &next = nextParticles;
+    std::copy(particles.x.begin() + begin, particles.x.begin() + end,
+              next.x.begin() + begin);
+    std::copy(particles.y.begin() + begin, particles.y.begin() + end,
+              next.y.begin() + begin);
+    std::copy(particles.z.begin() + begin, particles.z.begin() + end,
+              next.z.begin() + begin);
+    next.moveForward(rules.moveRate, begin, end);
+    for (int i = begin; i < end; i++)
+    {
+      jerkMag[i] = next.recordMotion(i, particles, particles.x[i],
+                                     particles.y[i], particles.z[i]);
+    }
+  }
+
+  // Same rules, but every particle sees last step's positions, headings and
+  // hues, so the particle range can be split across threads and the result
+  // does not depend on how.
+  int stepBuffered(float reach, float queryRadius)
+  {
+    std::atomic<int> mismatches{0};
+    if (rules.steerMode == ACCUMULATE)
+    {
+      for (auto *a : {&turnX, &turnY, &turnZ, &turnAmt})
+      {
+        a->resize(numParticles);
+      }
+    }
+    auto updateRange = [&](int begin, int end)
+    {
+      std::vector<int> found;
+      NeighborBatch batch;
+      drawTurns(begin, end);
+      for (int i = begin; i < end; i++)
+      {
+        updateBuffered(i, reach, queryRadius, found, batch, mismatches);
+      }
+      if (rules.steerMode == ACCUMULATE)
+      {
+        PhysarumParticles &next = nextParticles;
+        turnTowardBatch(end - begin, next.fx.data() + begin,
+                        next.fy.data() + begin, next.fz.data() + begin,
+                        turnX.data() + begin, turnY.data() + begin,
+                        turnZ.data() + begin, turnAmt.data() + begin);
+      }
+      moveBuffered(begin, end);
+    };
+    pool->parallelFor(numParticles, 256, updateRange);
+    std::swap(particles, nextParticles);
+    return mismatches;
+  }
+
+  // The random turn of particles [begin, end) this step: a point in the
+  // cube of half-width 1 from the counter-based generator, keyed by
+  // (seed, particle, step), so threads need no shared state and any split
+  // of the range draws the same numbers.
+  void drawTurns(int begin, int end)
+  {
+    Philox(seed).uniformS3(end - begin, begin, stepCount,
+                           randX.data() + begin, randY.data() + begin,
+                           randZ.data() + begin);
+  }
+
+  // direction of particle i's random turn, after drawTurns()
+  Float3 randomTurn(int i) const
+  {
+    Float3 rand(randX[i], randY[i], randZ[i]);
+    return rand.normalize();
+  }
+
+  int numParticles = 0;
+  uint64_t stepCount = 0;
+  uint64_t seed = 0;
+  aligned_vector<float> randX, randY, randZ;
+
+  SpatialGrid grid;
+  std::vector<int> neighbors;
+  // particles in grid.sorted order, for the batched buffered step
+  bool cellOrdered = false;
+  aligned_vector<float> cellX, cellY, cellZ, cellHue;
+  NeighborBatch serialBatch;
+
+  // back buffer of the double buffered step
+  PhysarumParticles nextParticles;
+  // each particle's summed steering target and amount, in ACCUMULATE mode
+  aligned_vector<float> turnX, turnY, turnZ, turnAmt;
+
+  std::vector<float> lastJerk; // previous step's, to spot crossings
+  // per range partial results of detectJerks()
+  std::vector<TopK<topJerks>> jerkParts;
+  std::vector<std::vector<int>> crossingParts;
+
+  std::unique_ptr<ThreadPool> pool;
+};
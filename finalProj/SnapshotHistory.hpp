@@ -0,0 +1,123 @@
+#pragma once
+
+// Timing for drawing ColorPhysarum between simulation steps.
+//
+// Every state chunk carries the primary's simulation time. A node keeps the
+// last three snapshots of each chunk, in a ring of vertex buffer slots, and
+// blend() says which two to draw each chunk between right now and how far
+// along, so the picture moves smoothly at the render rate whatever the
+// simulation rate or the network jitter.
+//
+// Render time runs on the local clock, shifted to simulation time by the
+// smallest lag seen (the least delayed packet; it creeps up slowly so a
+// lasting change in delay is picked up), then held back by the longest gap
+// between two snapshots of one chunk, `span`. Chunks arrive staggered, so
+// with two snapshots that is the only render time every chunk brackets;
+// the third snapshot gives another `span` of room, which `margin` uses to
+// absorb jitter.
+
+#include <algorithm>
+#include <vector>
+
+class SnapshotHistory
+{
+public:
+  static constexpr int slots = 3;
+
+  // seconds of extra delay to absorb network jitter, at most one span
+  double margin = 0.05;
+
+  int size() const { return (int)chunks.size(); }
+
+  void resize(int numChunks)
+  {
+    chunks.assign(numChunks, Chunk());
+    haveLag = false;
+  }
+
+  // A chunk stamped with simulation time `simTime` arrived at local time
+  // `now`. Returns the slot to write it to, or -1 if it is no newer than
+  // what the chunk already has.
+  int receive(int chunk, double simTime, double now)
+  {
+    Chunk &c = chunks[chunk];
+    double latest = c.time[c.latest];
+    if (latest >= 0 && simTime <= latest)
+    {
+      return -1;
+    }
+    c.latest = (c.latest + 1) % slots;
+    c.time[c.latest] = simTime;
+    if (latest >= 0)
+    {
+      c.span = simTime - latest;
+    }
+
+    double lag = now - simTime;
+    if (!haveLag || lag < this->lag)
+    {
+      this->lag = lag;
+      haveLag = true;
+    }
+    return c.latest;
+  }
+
+  // Simulation time to draw at local time `now`.
+  double renderTime(double now)
+  {
+    if (haveLag)
+    {
+      // let the lag estimate rise by 1% of elapsed time
+      lag += 0.01 * std::max(0.0, now - lastNow);
+    }
+    lastNow = now;
+
+    double span = 0;
+    for (const Chunk &c : chunks)
+    {
+      span = std::max(span, c.span);
+    }
+    return now - lag - span - std::min(margin, span);
+  }
+
+  // For each chunk, how far toward the later of the two snapshots around
+  // render time `t` to draw, and the slot of that later snapshot, as
+  // (weight, slot) pairs; the earlier one is in the slot before it. This is
+  // what the vertex shader's chunkBlend uniform expects.
+  void blend(double t, float *out) const
+  {
+    for (int k = 0; k < size(); k++)
+    {
+      const Chunk &c = chunks[k];
+      int to = c.latest;
+      int from = (to + slots - 1) % slots;
+      if (c.time[from] >= 0 && t < c.time[from] &&
+          c.time[(from + slots - 1) % slots] >= 0)
+      {
+        to = from;
+        from = (to + slots - 1) % slots;
+      }
+      float w = 1;
+      if (c.time[from] >= 0)
+      {
+        w = (float)((t - c.time[from]) / (c.time[to] - c.time[from]));
+        w = std::max(0.0f, std::min(w, 1.0f));
+      }
+      out[2 * k] = w;
+      out[2 * k + 1] = (float)to;
+    }
+  }
+
+private:
+  struct Chunk
+  {
+    double time[slots] = {-1, -1, -1}; // simulation time per slot, -1 if none
+    int latest = slots - 1;            // first write goes to slot 0
+    double span = 0;                   // between the last two snapshots
+  };
+
+  std::vector<Chunk> chunks;
+  double lag = 0; // local time minus simulation time, smallest seen
+  bool haveLag = false;
+  double lastNow = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+// Wire format for ColorPhysarum particles: 8 bytes instead of a Vec3f
+// position plus an HSV color (24 bytes).
+//
+// Positions are 16 bit fixed point over [-positionBound, positionBound] on
+// each axis. The sim turns particles back once they pass radius 5, so 8
+// leaves room for overshoot; anything beyond is clamped to the boundary.
+// Worst case error is half a step, 16 / 65535 / 2 = 1.2e-4 per axis (2.1e-4
+// as a distance), far below a point sprite's size. Saturation and value are
+// always 1, so only hue is sent, 16 bit, wrapped into [0, 1); its error is at
+// most 7.6e-6.
+
+#include <cmath>
+#include <cstdint>
+
+const float positionBound = 8;
+
+// Also the vertex format on the GPU (PackedPointBuffer.hpp), decoded by
+// packed-vertex.glsl; keep the two in step.
+struct PackedParticle
+{
+  uint16_t x, y, z;
+  uint16_t hue;
+};
+static_assert(sizeof(PackedParticle) == 8, "packed as four uint16_t");
+
+inline uint16_t encodeCoord(float v)
+{
+  float t = (v + positionBound) * (65535 / (2 * positionBound));
+  t = t < 0 ? 0 : (t > 65535 ? 65535 : t);
+  return (uint16_t)(t + 0.5f);
+}
+
+inline float decodeCoord(uint16_t q)
+{
+  return q * (2 * positionBound / 65535) - positionBound;
+}
+
+inline uint16_t encodeHue(float h)
+{
+  h -= std::floor(h);
+  // 1.0 would round up to 65536, which is the same hue as 0
+  return (uint16_t)((uint32_t)(h * 65536 + 0.5f) & 0xffff);
+}
+
+inline float decodeHue(uint16_t q)
+{
+  return q * (1.0f / 65536);
+}
+
+inline PackedParticle encodeParticle(float x, float y, float z, float hue)
+{
+  return {encodeCoord(x), encodeCoord(y), encodeCoord(z), encodeHue(hue)};
+}
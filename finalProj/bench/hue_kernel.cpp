@@ -0,0 +1,76 @@
+// Checks the batched interaction kernel against the scalar one and times
+// both. Two simulations are run to the same settled state, then take one
+// step each, one per kernel, and their headings and hues are compared.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread hue_kernel.cpp -o hue_kernel
+// usage: ./hue_kernel [particles] [steps] [settle]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../PhysarumSim.hpp"
+
+double secondsPerStep(PhysarumSim &sim, int steps)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; s++)
+  {
+    sim.step();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count() /
+         steps;
+}
+
+void compare(int n, int stepMode, int steps, int settle)
+{
+  PhysarumSim scalar, batched;
+  for (PhysarumSim *sim : {&scalar, &batched})
+  {
+    sim->rules.stepMode = stepMode;
+    sim->rules.kernel = SCALAR;
+    sim->threads(1);
+    sim->resize(n);
+    sim->scatter(1);
+    for (int s = 0; s < settle; s++)
+    {
+      sim->step();
+    }
+  }
+  batched.rules.kernel = BATCHED;
+  scalar.step();
+  batched.step();
+
+  const PhysarumParticles &a = scalar.particles, &b = batched.particles;
+  int differ = 0;
+  float worstHeading = 0, worstHue = 0;
+  for (int i = 0; i < n; i++)
+  {
+    Float3 da = scalar.heading(i), db = batched.heading(i);
+    float e = (da - db).mag();
+    differ += e > 1e-3f;
+    worstHeading = std::max(worstHeading, e);
+    worstHue = std::max(worstHue, std::fabs(a.hue[i] - b.hue[i]));
+  }
+
+  double ts = secondsPerStep(scalar, steps);
+  double tb = secondsPerStep(batched, steps);
+  printf("%8d %9s %10.3f %10.3f %8.2fx %10.2e %10.2e %8d\n", n,
+         stepMode == SERIAL ? "serial" : "buffered", ts * 1e3, tb * 1e3,
+         ts / tb, worstHeading, worstHue, differ);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 10000;
+  int steps = argc > 2 ? atoi(argv[2]) : 5;
+  int settle = argc > 3 ? atoi(argv[3]) : 40;
+  printf("one thread; last three columns compare one step from equal states\n");
+  printf("%8s %9s %10s %10s %9s %10s %10s %8s\n", "n", "step",
+         "scalar ms", "batched ms", "speedup", "heading", "hue", ">1e-3");
+  compare(n, DOUBLE_BUFFERED, steps, settle);
+  compare(n, SERIAL, steps, settle);
+  return 0;
+}
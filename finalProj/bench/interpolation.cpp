@@ -0,0 +1,270 @@
+// Checks replica-side interpolation (SnapshotHistory.hpp) with a real
+// primary and replica process on one machine and injected network delay.
+//
+// The primary process steps particles on known circles at `simRate`, and
+// once per frame at `sendRate` sends the next state chunk, like
+// ColorPhysarum. Packets wait in a delay line for `delay` ms plus up to
+// `jitter` ms of uniform random jitter, so they can arrive out of order.
+// The replica renders at `renderRate`, twice: once drawing the latest
+// snapshot of each chunk as before, and once blending snapshots the way
+// packed-vertex.glsl does. For each it reports the error against the true
+// circle position at the shown time and how unevenly points move from
+// frame to frame (RMS second difference, relative to the true motion).
+//
+// build: g++ -O2 -std=c++17 interpolation.cpp -o interpolation
+// usage: ./interpolation [simRate] [renderRate] [delay ms] [jitter ms]
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../SnapshotHistory.hpp"
+#include "../StateEncoding.hpp"
+
+const int numParticles = 20000;
+const int chunkSize = 6144;
+const int numChunks = (numParticles + chunkSize - 1) / chunkSize;
+const double sendRate = 60;
+const double runSeconds = 4;
+
+struct Packet
+{
+  int chunk;
+  double simTime;
+  PackedParticle packed[chunkSize];
+};
+
+double seconds()
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// particle i at simulation time t, radius 1 to 4, a few seconds per turn
+void truth(int i, double t, float &x, float &y, float &z)
+{
+  float r = 1 + 3 * (i % 97) / 97.0f;
+  float w = 0.5f + (i % 13) * 0.1f;
+  float a = w * (float)t + i * 0.37f;
+  x = r * std::cos(a);
+  y = r * std::sin(a);
+  z = (i % 7) * 0.3f - 1;
+}
+
+void primary(int socket, double simRate, double delay, double jitter)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::vector<PackedParticle> packed(numParticles);
+  struct Pending
+  {
+    double due;
+    Packet packet;
+  };
+  std::deque<Pending> line;
+
+  double start = seconds(), nextFrame = start, simTime = -1;
+  int nextChunk = 0;
+  while (seconds() - start < runSeconds + 1)
+  {
+    double now = seconds();
+    if (now >= nextFrame)
+    {
+      nextFrame += 1 / sendRate;
+      // fixed rate simulation, as onAnimate does
+      double stepTime = std::floor((now - start) * simRate) / simRate;
+      if (stepTime > simTime)
+      {
+        simTime = stepTime;
+        for (int i = 0; i < numParticles; i++)
+        {
+          float x, y, z;
+          truth(i, simTime, x, y, z);
+          packed[i] = encodeParticle(x, y, z, 0.5f);
+        }
+      }
+      Pending p;
+      p.due = now + (delay + jitter * uniform(rng)) / 1000;
+      p.packet.chunk = nextChunk;
+      p.packet.simTime = simTime;
+      int begin = nextChunk * chunkSize;
+      int count = std::min(chunkSize, numParticles - begin);
+      std::copy(packed.begin() + begin, packed.begin() + begin + count,
+                p.packet.packed);
+      line.push_back(p);
+      nextChunk = (nextChunk + 1) % numChunks;
+    }
+    // jitter reorders: send whatever is due, in due order
+    std::sort(line.begin(), line.end(), [](const Pending &a, const Pending &b)
+              { return a.due < b.due; });
+    while (!line.empty() && line.front().due <= now)
+    {
+      send(socket, &line.front().packet, sizeof(Packet), 0);
+      line.pop_front();
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+struct Quality
+{
+  double error = 0, unevenness = 0, lag = 0;
+  int frames = 0;
+};
+
+void replica(int socket, double renderRate)
+{
+  SnapshotHistory history;
+  history.resize(numChunks);
+  // [slot][particle], as in the vertex buffer
+  std::vector<PackedParticle> slots[SnapshotHistory::slots];
+  for (auto &slot : slots)
+  {
+    slot.resize(numParticles);
+  }
+  std::vector<double> latestTime(numChunks, -1);
+  std::vector<int> latestSlot(numChunks, 0);
+
+  // last two drawn frames per method, for the second difference
+  std::vector<float> drawn[2][2];
+  std::vector<float> truthDrawn[2][2];
+  Quality quality[2];
+  std::vector<float> blend(2 * numChunks);
+
+  Packet packet;
+  double start = seconds(), nextFrame = start + 1; // 1 s to settle
+  int frame = 0;
+  while (seconds() - start < runSeconds)
+  {
+    while (recv(socket, &packet, sizeof packet, MSG_DONTWAIT) > 0)
+    {
+      int slot = history.receive(packet.chunk, packet.simTime, seconds());
+      if (slot < 0)
+      {
+        continue;
+      }
+      latestTime[packet.chunk] = packet.simTime;
+      latestSlot[packet.chunk] = slot;
+      int begin = packet.chunk * chunkSize;
+      int count = std::min(chunkSize, numParticles - begin);
+      std::copy(packet.packed, packet.packed + count,
+                slots[slot].begin() + begin);
+    }
+
+    double now = seconds();
+    if (now < nextFrame)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    nextFrame += 1 / renderRate;
+    double t = history.renderTime(now);
+    history.blend(t, blend.data());
+
+    for (int method = 0; method < 2; method++)
+    {
+      std::vector<float> frameXYZ(3 * numParticles), truthXYZ(3 * numParticles);
+      double err = 0;
+      for (int i = 0; i < numParticles; i++)
+      {
+        int c = i / chunkSize;
+        float w = method == 0 ? 1 : blend[2 * c];
+        int to = method == 0 ? latestSlot[c] : (int)blend[2 * c + 1];
+        const PackedParticle &b = slots[to][i];
+        const PackedParticle &a = slots[(to + 2) % 3][i];
+        float x = decodeCoord(a.x) + (decodeCoord(b.x) - decodeCoord(a.x)) * w;
+        float y = decodeCoord(a.y) + (decodeCoord(b.y) - decodeCoord(a.y)) * w;
+        float z = decodeCoord(a.z) + (decodeCoord(b.z) - decodeCoord(a.z)) * w;
+        // against the moment this method is showing
+        float tx, ty, tz;
+        truth(i, method == 0 ? latestTime[c] : t, tx, ty, tz);
+        err += (x - tx) * (x - tx) + (y - ty) * (y - ty) + (z - tz) * (z - tz);
+        frameXYZ[3 * i] = x;
+        frameXYZ[3 * i + 1] = y;
+        frameXYZ[3 * i + 2] = z;
+        // the path a perfectly smooth picture at this render time would take
+        truth(i, t, tx, ty, tz);
+        truthXYZ[3 * i] = tx;
+        truthXYZ[3 * i + 1] = ty;
+        truthXYZ[3 * i + 2] = tz;
+      }
+      Quality &q = quality[method];
+      if (frame >= 2)
+      {
+        double d2 = 0;
+        for (int k = 0; k < 3 * numParticles; k++)
+        {
+          float drawnAcc = frameXYZ[k] - 2 * drawn[method][1][k] +
+                           drawn[method][0][k];
+          float trueAcc = truthXYZ[k] - 2 * truthDrawn[method][1][k] +
+                          truthDrawn[method][0][k];
+          d2 += (drawnAcc - trueAcc) * (drawnAcc - trueAcc);
+        }
+        q.unevenness += std::sqrt(d2 / numParticles);
+        q.error += std::sqrt(err / numParticles);
+        double newest = *std::max_element(latestTime.begin(), latestTime.end());
+        q.lag += newest - (method == 0 ? newest : t);
+        q.frames++;
+      }
+      drawn[method][0].swap(drawn[method][1]);
+      drawn[method][1] = frameXYZ;
+      truthDrawn[method][0].swap(truthDrawn[method][1]);
+      truthDrawn[method][1] = truthXYZ;
+    }
+    frame++;
+  }
+
+  const char *names[] = {"latest", "interpolated"};
+  for (int method = 0; method < 2; method++)
+  {
+    Quality &q = quality[method];
+    printf("  %-13s error %.2e  unevenness %.2e  behind newest %5.1f ms  "
+           "(%d frames)\n",
+           names[method], q.error / q.frames, q.unevenness / q.frames,
+           1000 * q.lag / q.frames, q.frames);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  double simRate = argc > 1 ? atof(argv[1]) : 30;
+  double renderRate = argc > 2 ? atof(argv[2]) : 60;
+  double delay = argc > 3 ? atof(argv[3]) : 20;
+  double jitter = argc > 4 ? atof(argv[4]) : 15;
+  printf("%d particles in %d chunks, sim %.0f Hz, send %.0f Hz, render "
+         "%.0f Hz, delay %.0f + 0..%.0f ms\n",
+         numParticles, numChunks, simRate, sendRate, renderRate, delay,
+         jitter);
+  fflush(stdout);
+
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) != 0)
+  {
+    perror("socketpair");
+    return 1;
+  }
+  int bytes = 64 * sizeof(Packet);
+  setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &bytes, sizeof bytes);
+
+  pid_t child = fork();
+  if (child == 0)
+  {
+    close(sockets[0]);
+    replica(sockets[1], renderRate);
+    return 0;
+  }
+  close(sockets[1]);
+  primary(sockets[0], simRate, delay, jitter);
+  waitpid(child, nullptr, 0);
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Offline benchmark for OscillatorBank: renders N voices x M blocks with no
+// audio device and reports the real-time factor.
+//
+// build: g++ -O3 -march=native -std=c++17 oscillator_bank.cpp -o oscillator_bank
+// usage: ./oscillator_bank [blocks]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/OscillatorBank.hpp"
+
+const float sampleRate = 44100;
+const int blockSize = 512;
+
+// seconds of wall time per block
+double timeBlock(int voices, int blocks)
+{
+  OscillatorBank bank(voices, sampleRate);
+  std::vector<float> out(blockSize);
+  float sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < blocks; b++)
+  {
+    // new targets every block, like per-particle control data would be
+    for (int v = 0; v < voices; v++)
+    {
+      bank.set(v, 100 + 10 * v + b % 7, 1.0f / voices);
+    }
+    std::fill(out.begin(), out.end(), 0.0f);
+    bank.render(out.data(), blockSize);
+    sink += out[b % blockSize];
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (sink == 12345)
+  {
+    printf(" "); // keep the work observable
+  }
+  return seconds / blocks;
+}
+
+int main(int argc, char *argv[])
+{
+  int blocks = argc > 1 ? atoi(argv[1]) : 200;
+  double period = blockSize / sampleRate;
+  printf("%d frame blocks at %.0f Hz: %.2f ms per block\n", blockSize,
+         sampleRate, period * 1e3);
+  printf("%8s %12s %12s %14s\n", "voices", "ms/block", "RT factor",
+         "ns/voice/frame");
+
+  for (int voices : {16, 64, 256, 1024, 4096})
+  {
+    double t = timeBlock(voices, blocks);
+    printf("%8d %12.3f %12.1f %14.2f\n", voices, t * 1e3, period / t,
+           t * 1e9 / voices / blockSize);
+  }
+
+  // largest voice count that leaves half the audio deadline for everything
+  // else (spatialization, the rest of onSound)
+  int lo = 16, hi = 1 << 16;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2 / OscillatorBank::lanes * OscillatorBank::lanes;
+    if (mid <= lo)
+    {
+      break;
+    }
+    if (timeBlock(mid, 20) < period / 2)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+  printf("about %d voices fit in half of a %d frame buffer\n", lo,
+         blockSize);
+  return 0;
+}
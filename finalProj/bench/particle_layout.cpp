@@ -0,0 +1,330 @@
+// The ColorPhysarum agent store before and after it became structure of
+// arrays: step time and memory bandwidth at 10k and 100k agents.
+//
+//   aos  as ColorPhysarum had it: an array of Nav (laid out like
+//        al::Nav's members: pose and quaternion in doubles, the move, spin,
+//        turn and nudge vectors, the cached unit vectors, smoothing),
+//        oldPos, vel, oldVel, acc and oldAcc as separate Vec3f arrays, and
+//        the hues in the mesh's colours
+//   soa  PhysarumParticles: one aligned float array per component
+//
+// Both run the same simplified step, one thread, agents in the 6 x 6 x 6
+// box the app starts from:
+//   stream    every agent moves along its heading and records its
+//             velocity and acceleration: a pass with no neighbours
+//   neighbor  a grid of cells `sight` wide, then each agent turns by its
+//             neighbours within sight (toward similar hues, away from
+//             others), moves and records its motion
+// Bandwidth is the state each pass needs, per second: 84 bytes per agent
+// for `stream` (position, heading, velocity and acceleration read; the
+// three written), plus 16 per neighbour visited (position and hue) for
+// `neighbor`. The same count for both layouts, so it compares how fast
+// each gets the same data through; `footprint` is what an agent occupies.
+//
+// build: g++ -O3 -march=native -std=c++17 particle_layout.cpp
+//          -o particle_layout
+// usage: ./particle_layout [steps]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../PhysarumParticles.hpp"
+
+const float sight = 0.45f, moveRate = 0.055f;
+
+struct Vec3f
+{
+  float x, y, z;
+};
+
+struct Vec3d
+{
+  double x, y, z;
+};
+
+// al::Nav's data members, in order
+struct Nav
+{
+  Vec3d pos;
+  double quat[4];
+  Vec3d move0, move1, spin0, spin1, turn, nudge;
+  Vec3d ur, uu, uf; // unit vectors, kept up to date from quat
+  double smooth, velScale;
+  bool pullBack0, pullBack1;
+};
+
+struct Hsv
+{
+  float h, s, v;
+};
+
+struct Aos
+{
+  std::vector<Nav> nav;
+  std::vector<Vec3f> oldPos, vel, oldVel, acc, oldAcc;
+  std::vector<Hsv> colors;
+
+  static constexpr int footprint =
+      sizeof(Nav) + 5 * sizeof(Vec3f) + sizeof(Hsv);
+
+  int size() const { return (int)nav.size(); }
+  float x(int i) const { return (float)nav[i].pos.x; }
+  float y(int i) const { return (float)nav[i].pos.y; }
+  float z(int i) const { return (float)nav[i].pos.z; }
+  float hue(int i) const { return colors[i].h; }
+  Vec3f heading(int i) const
+  {
+    return {(float)nav[i].uf.x, (float)nav[i].uf.y, (float)nav[i].uf.z};
+  }
+
+  // Nav::faceToward then moveF and step, reduced to what they change
+  void move(int i, Vec3f f)
+  {
+    Nav &n = nav[i];
+    n.uf = {f.x, f.y, f.z};
+    n.quat[0] = std::sqrt(std::max(0.0, 1 - f.z * (double)f.z));
+    n.pos.x += f.x * moveRate;
+    n.pos.y += f.y * moveRate;
+    n.pos.z += f.z * moveRate;
+  }
+
+  // the old vel / acc bookkeeping, by way of oldPos
+  void record(int i)
+  {
+    Vec3f p = {x(i), y(i), z(i)};
+    Vec3f v = {p.x - oldPos[i].x, p.y - oldPos[i].y, p.z - oldPos[i].z};
+    acc[i] = {v.x - oldVel[i].x, v.y - oldVel[i].y, v.z - oldVel[i].z};
+    vel[i] = v;
+    oldAcc[i] = acc[i];
+    oldVel[i] = v;
+    oldPos[i] = p;
+  }
+};
+
+struct Soa
+{
+  PhysarumParticles p;
+
+  static constexpr int footprint = 13 * sizeof(float);
+
+  int size() const { return p.size(); }
+  float x(int i) const { return p.x[i]; }
+  float y(int i) const { return p.y[i]; }
+  float z(int i) const { return p.z[i]; }
+  float hue(int i) const { return p.hue[i]; }
+  Vec3f heading(int i) const { return {p.fx[i], p.fy[i], p.fz[i]}; }
+
+  void move(int i, Vec3f f)
+  {
+    p.setHeading(i, f.x, f.y, f.z);
+    p.setPosition(i, p.x[i] + f.x * moveRate, p.y[i] + f.y * moveRate,
+                  p.z[i] + f.z * moveRate);
+  }
+
+  void record(int i) { p.recordMotion(i, p, p.x[i], p.y[i], p.z[i]); }
+};
+
+void scatter(Aos &a, Soa &s, int n)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> signed1(-1, 1), unit(0, 1);
+  a.nav.assign(n, Nav{});
+  for (auto *v : {&a.oldPos, &a.vel, &a.oldVel, &a.acc, &a.oldAcc})
+  {
+    v->assign(n, Vec3f{0, 0, 0});
+  }
+  a.colors.resize(n);
+  s.p.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    float p[3], f[3];
+    for (int c = 0; c < 3; c++)
+    {
+      p[c] = signed1(rng) * 3;
+      f[c] = signed1(rng);
+    }
+    float m = std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]) + 1e-6f;
+    float h = unit(rng);
+    a.nav[i].pos = {p[0], p[1], p[2]};
+    a.nav[i].uf = {f[0] / m, f[1] / m, f[2] / m};
+    a.colors[i] = {h, 1, 1};
+    s.p.setPosition(i, p[0], p[1], p[2]);
+    s.p.setHeading(i, f[0] / m, f[1] / m, f[2] / m);
+    s.p.hue[i] = h;
+  }
+}
+
+// cells `sight` wide over the agents' bounding box, by counting sort
+struct Grid
+{
+  float lo[3], width;
+  int dims[3];
+  std::vector<int> start, order;
+
+  template <class Store>
+  void build(const Store &s)
+  {
+    int n = s.size();
+    float hi[3] = {s.x(0), s.y(0), s.z(0)};
+    std::copy(hi, hi + 3, lo);
+    for (int i = 1; i < n; i++)
+    {
+      float p[3] = {s.x(i), s.y(i), s.z(i)};
+      for (int c = 0; c < 3; c++)
+      {
+        lo[c] = std::min(lo[c], p[c]);
+        hi[c] = std::max(hi[c], p[c]);
+      }
+    }
+    width = sight;
+    for (int c = 0; c < 3; c++)
+    {
+      dims[c] = (int)((hi[c] - lo[c]) / width) + 1;
+    }
+    start.assign(dims[0] * dims[1] * dims[2] + 1, 0);
+    std::vector<int> cellOf(n);
+    for (int i = 0; i < n; i++)
+    {
+      cellOf[i] = index(s.x(i), s.y(i), s.z(i));
+      start[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < start.size(); c++)
+    {
+      start[c] += start[c - 1];
+    }
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    order.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+      order[fill[cellOf[i]]++] = i;
+    }
+  }
+
+  int coord(float p, int c) const
+  {
+    return std::min(std::max((int)((p - lo[c]) / width), 0), dims[c] - 1);
+  }
+
+  int index(float px, float py, float pz) const
+  {
+    return (coord(pz, 2) * dims[1] + coord(py, 1)) * dims[0] + coord(px, 0);
+  }
+};
+
+// one step in place; returns the neighbours visited
+template <class Store>
+long neighborStep(Store &s, Grid &grid)
+{
+  grid.build(s);
+  long visited = 0;
+  for (int i = 0; i < s.size(); i++)
+  {
+    float px = s.x(i), py = s.y(i), pz = s.z(i), h = s.hue(i);
+    Vec3f f = s.heading(i), steer = {0, 0, 0};
+    int c[3] = {grid.coord(px, 0), grid.coord(py, 1), grid.coord(pz, 2)};
+    for (int cz = std::max(c[2] - 1, 0);
+         cz <= std::min(c[2] + 1, grid.dims[2] - 1); cz++)
+    {
+      for (int cy = std::max(c[1] - 1, 0);
+           cy <= std::min(c[1] + 1, grid.dims[1] - 1); cy++)
+      {
+        for (int cx = std::max(c[0] - 1, 0);
+             cx <= std::min(c[0] + 1, grid.dims[0] - 1); cx++)
+        {
+          int cell = (cz * grid.dims[1] + cy) * grid.dims[0] + cx;
+          for (int k = grid.start[cell]; k < grid.start[cell + 1]; k++)
+          {
+            int j = grid.order[k];
+            float dx = s.x(j) - px, dy = s.y(j) - py, dz = s.z(j) - pz;
+            float d = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (j == i || d >= sight)
+            {
+              continue;
+            }
+            visited++;
+            float dh = std::fabs(s.hue(j) - h);
+            float w = (0.2f - std::min(dh, 1 - dh)) / d; // + toward
+            steer.x += dx * w;
+            steer.y += dy * w;
+            steer.z += dz * w;
+          }
+        }
+      }
+    }
+    f = {f.x + steer.x * .01f, f.y + steer.y * .01f, f.z + steer.z * .01f};
+    float m = std::sqrt(f.x * f.x + f.y * f.y + f.z * f.z) + 1e-12f;
+    s.move(i, {f.x / m, f.y / m, f.z / m});
+    s.record(i);
+  }
+  return visited;
+}
+
+template <class Store>
+void streamStep(Store &s)
+{
+  for (int i = 0; i < s.size(); i++)
+  {
+    s.move(i, s.heading(i));
+    s.record(i);
+  }
+}
+
+template <class F>
+double seconds(F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// the neighbour steps first: the stream passes carry the agents out of
+// the box
+template <class Store>
+void run(const char *name, Store &s, int steps)
+{
+  int n = s.size();
+  Grid grid;
+  long visited = 0;
+  double step = seconds([&]
+                        {
+                          for (int k = 0; k < steps; k++)
+                          {
+                            visited += neighborStep(s, grid);
+                          } }) /
+                steps;
+  visited /= steps;
+  double stream = seconds([&]
+                          {
+                            for (int k = 0; k < steps * 10; k++)
+                            {
+                              streamStep(s);
+                            } }) /
+                  (steps * 10);
+  printf("%6s %10d %10.3f %8.2f %12.2f %10.1f %8.2f\n", name,
+         Store::footprint, stream * 1e3, 84.0 * n / stream / 1e9, step * 1e3,
+         (double)visited / n, (84.0 * n + 16.0 * visited) / step / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+  int steps = argc > 1 ? atoi(argv[1]) : 5;
+  for (int n : {10000, 100000})
+  {
+    Aos aos;
+    Soa soa;
+    scatter(aos, soa, n);
+    printf("%d agents\n", n);
+    printf("%6s %10s %10s %8s %12s %10s %8s\n", "", "footprint",
+           "stream ms", "GB/s", "neighbor ms", "neighbors", "GB/s");
+    run("aos", aos, steps);
+    run("soa", soa, steps);
+    printf("\n");
+  }
+}
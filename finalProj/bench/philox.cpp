@@ -0,0 +1,109 @@
+// Times Philox.hpp's draws against std::mt19937 and checks that the batch
+// draws equal the one-at-a-time ones and that threads splitting the range
+// any way get the same numbers as one serial pass.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread philox.cpp -o philox
+// usage: ./philox [particles] [steps]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../../common/Philox.hpp"
+
+template <class F>
+double nsPerDraw(long draws, F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         draws;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 100000;
+  int steps = argc > 2 ? atoi(argv[2]) : 100;
+  long draws = (long)n * steps;
+  std::vector<float> x(n), y(n), z(n);
+  volatile float sink = 0; // keeps the draws from being optimized away
+
+  std::mt19937 mt(1);
+  std::uniform_real_distribution<float> uniformS(-1, 1);
+  double tMt = nsPerDraw(draws, [&]
+                         {
+    for (int s = 0; s < steps; s++)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        x[i] = uniformS(mt);
+        y[i] = uniformS(mt);
+        z[i] = uniformS(mt);
+      }
+      sink = sink + x[s % n];
+    } });
+
+  Philox rng(1);
+  double tScalar = nsPerDraw(draws, [&]
+                             {
+    for (int s = 0; s < steps; s++)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        auto v = rng.uniformS3(i, s);
+        x[i] = v[0];
+        y[i] = v[1];
+        z[i] = v[2];
+      }
+      sink = sink + x[s % n];
+    } });
+
+  double tBatch = nsPerDraw(draws, [&]
+                            {
+    for (int s = 0; s < steps; s++)
+    {
+      rng.uniformS3(n, 0, s, x.data(), y.data(), z.data());
+      sink = sink + x[s % n];
+    } });
+
+  // batch against scalar, and four threads against one pass
+  int step = steps;
+  std::vector<float> px(n), py(n), pz(n);
+  rng.uniformS3(n, 0, step, x.data(), y.data(), z.data());
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++)
+  {
+    threads.emplace_back([&, t]
+                         {
+      // uneven split, on purpose
+      int begin = (long)n * t * t / 16, end = (long)n * (t + 1) * (t + 1) / 16;
+      for (int i = begin; i < end; i++)
+      {
+        auto v = rng.uniformS3(i, step);
+        px[i] = v[0];
+        py[i] = v[1];
+        pz[i] = v[2];
+      } });
+  }
+  for (auto &t : threads)
+  {
+    t.join();
+  }
+  int differ = 0;
+  for (int i = 0; i < n; i++)
+  {
+    differ += x[i] != px[i] || y[i] != py[i] || z[i] != pz[i];
+  }
+
+  printf("%d particles x %d steps, ns per random 3-vector\n", n, steps);
+  printf("  %-14s %6.2f\n", "std::mt19937", tMt);
+  printf("  %-14s %6.2f\n", "Philox scalar", tScalar);
+  printf("  %-14s %6.2f\n", "Philox batch", tBatch);
+  printf("threaded vs batch: %d of %d differ\n", differ, n);
+  return differ > 0;
+}
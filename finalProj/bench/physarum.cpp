@@ -0,0 +1,102 @@
+// Offline benchmark for the ColorPhysarum rules (PhysarumSim): no window,
+// audio or network. Runs each particle count for a number of steps and
+// reports throughput and the process's peak resident set size.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread physarum.cpp -o physarum
+// usage: ./physarum [serial|buffered] [threads] [scale] [settle] [density]
+//
+// Each count is timed for 200k / n steps times `scale` (default 1), but
+// never fewer than 2, after `settle` untimed steps (default 40). Peak RSS
+// only grows, so the counts run smallest first and each line shows the
+// peak up to that point.
+//
+// By default the world keeps its size, so larger counts are also denser.
+// With `density`, each count gets worldScale sqrt(n / density) instead,
+// and sees as many neighbors as `density` particles do in the default
+// world. The scattered cube grows with the world and takes that much
+// longer to reach the shell, so `settle` is scaled by it too.
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../PhysarumSim.hpp"
+
+long peakRssKb()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss; // kilobytes on Linux
+}
+
+int main(int argc, char *argv[])
+{
+  int stepMode = DOUBLE_BUFFERED;
+  if (argc > 1 && strcmp(argv[1], "serial") == 0)
+  {
+    stepMode = SERIAL;
+  }
+  int threads = argc > 2 ? atoi(argv[2]) : 0;
+  double scale = argc > 3 ? atof(argv[3]) : 1;
+  int settle = argc > 4 ? atoi(argv[4]) : 40;
+  double density = argc > 5 ? atof(argv[5]) : 0;
+
+  printf("%s step, %s threads\n", stepMode == SERIAL ? "serial" : "buffered",
+         threads > 0 ? argv[2] : "all");
+  printf("%10s %7s %8s %12s %14s %14s %12s\n", "particles", "world",
+         "steps", "steps/s", "ns/particle", "neighbors/p", "peak RSS MB");
+
+  for (int n : {1000, 10000, 100000})
+  {
+    PhysarumSim sim;
+    sim.rules.stepMode = stepMode;
+    if (density > 0)
+    {
+      sim.rules.worldScale = std::sqrt(n / density);
+    }
+    sim.threads(threads);
+    sim.resize(n);
+    sim.scatter(1);
+
+    // the scattered cube collapses onto the shell within a few dozen
+    // steps; time the settled state, which is denser and slower
+    int steps = std::max(2, (int)(scale * 200000 / n));
+    int settleSteps = (int)(settle * sim.rules.worldScale);
+    for (int s = 0; s < settleSteps; s++)
+    {
+      sim.step();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++)
+    {
+      sim.step();
+      sim.detectJerks(0.01f);
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    // average neighbor count in the settled state, for context
+    double pairs = 0;
+    int sampled = 0;
+    float reach = std::max(sim.rules.sight, sim.rules.minDist);
+    for (int i = 0; i < n; i += std::max(1, n / 500))
+    {
+      sampled++;
+      Float3 p = sim.position(i);
+      for (int j = 0; j < n; j++)
+      {
+        pairs += j != i && (sim.position(j) - p).mag() < reach;
+      }
+    }
+
+    printf("%10d %7.2f %8d %12.2f %14.1f %14.1f %12.1f\n", n,
+           sim.rules.worldScale, steps, steps / seconds, seconds * 1e9 / ((double)steps * n),
+           pairs / sampled, peakRssKb() / 1024.0);
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+// Times PoseBatch's batch faceToward + step against one call per agent, and
+// checks the batch results against the scalar references.
+//
+// The batch is timed against al::Nav when allolib is on the include path
+// and against PoseBatch's scalar reference otherwise; both do the same
+// math. The first line of the output names the baseline used.
+//
+// build: g++ -O3 -march=native -std=c++17 pose_batch.cpp -o pose_batch
+//        (add -I<allolib>/include and link allolib to time al::Nav)
+// usage: ./pose_batch [agents] [steps]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../../common/PoseBatch.hpp"
+
+#if __has_include("al/spatial/al_Pose.hpp")
+#include "al/spatial/al_Pose.hpp"
+#define HAVE_NAV 1
+#endif
+
+struct Targets
+{
+  std::vector<float> x, y, z, amt;
+};
+
+// new targets every step, like a flock chasing moving food would see
+Targets makeTargets(int n, int steps, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> uniformS(-2, 2), uniform(0, 0.2f);
+  Targets t;
+  for (int k = 0; k < n * steps; k++)
+  {
+    t.x.push_back(uniformS(rng));
+    t.y.push_back(uniformS(rng));
+    t.z.push_back(uniformS(rng));
+    t.amt.push_back(uniform(rng));
+  }
+  return t;
+}
+
+PoseBatch scatter(int n)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniformS(-1, 1);
+  PoseBatch p;
+  p.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    p.setPosition(i, uniformS(rng), uniformS(rng), uniformS(rng));
+    p.faceToward(i, uniformS(rng), uniformS(rng), uniformS(rng), 1);
+  }
+  p.moveF(0.02f, 0, n);
+  return p;
+}
+
+template <class F>
+double msPerStep(int steps, F &&f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; s++)
+  {
+    f(s);
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         steps;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 10000;
+  int steps = argc > 2 ? atoi(argv[2]) : 100;
+  Targets t = makeTargets(n, steps, 2);
+
+  PoseBatch reference = scatter(n), batch = scatter(n);
+
+#ifdef HAVE_NAV
+  std::vector<al::Nav> navs(n);
+  for (int i = 0; i < n; i++)
+  {
+    auto q = reference.quat(i);
+    auto p = reference.position(i);
+    navs[i].pos(p[0], p[1], p[2]);
+    navs[i].quat().set(q[0], q[1], q[2], q[3]);
+    navs[i].moveF(0.02);
+  }
+  double tNav = msPerStep(steps, [&](int s)
+                          {
+    for (int i = 0; i < n; i++)
+    {
+      int k = s * n + i;
+      navs[i].faceToward(al::Vec3d(t.x[k], t.y[k], t.z[k]), t.amt[k]);
+      navs[i].step();
+    } });
+  const char *perAgent = "al::Nav";
+#else
+  double tNav = 0;
+  const char *perAgent = "reference";
+#endif
+
+  double tRef = msPerStep(steps, [&](int s)
+                          {
+    for (int i = 0; i < n; i++)
+    {
+      int k = s * n + i;
+      reference.faceToward(i, t.x[k], t.y[k], t.z[k], t.amt[k]);
+    }
+    reference.step(); });
+
+  double tBatch = msPerStep(steps, [&](int s)
+                            {
+    int k = s * n;
+    batch.faceToward(t.x.data() + k, t.y.data() + k, t.z.data() + k,
+                     t.amt.data() + k, 0, n);
+    batch.step(); });
+
+  // drift after `steps` steps of feedback through position
+  float worstQuat = 0, worstPos = 0;
+  for (int i = 0; i < n; i++)
+  {
+    auto a = reference.quat(i), b = batch.quat(i);
+    // q and -q are the same rotation
+    float same = 0, opposite = 0;
+    for (int c = 0; c < 4; c++)
+    {
+      same = std::max(same, std::fabs(a[c] - b[c]));
+      opposite = std::max(opposite, std::fabs(a[c] + b[c]));
+    }
+    worstQuat = std::max(worstQuat, std::min(same, opposite));
+    auto p = reference.position(i), q = batch.position(i);
+    for (int c = 0; c < 3; c++)
+    {
+      worstPos = std::max(worstPos, std::fabs(p[c] - q[c]));
+    }
+  }
+
+  // forward vectors alone, one turn each from the same start
+  std::vector<float> fx(n), fy(n), fz(n), gx, gy, gz;
+  for (int i = 0; i < n; i++)
+  {
+    auto f = reference.uf(i);
+    fx[i] = f[0];
+    fy[i] = f[1];
+    fz[i] = f[2];
+  }
+  gx = fx;
+  gy = fy;
+  gz = fz;
+  float worstTurn = 0;
+  for (int i = 0; i < n; i++)
+  {
+    turnToward(fx[i], fy[i], fz[i], t.x[i], t.y[i], t.z[i], t.amt[i]);
+  }
+  turnTowardBatch(n, gx.data(), gy.data(), gz.data(), t.x.data(),
+                  t.y.data(), t.z.data(), t.amt.data());
+  for (int i = 0; i < n; i++)
+  {
+    worstTurn = std::max({worstTurn, std::fabs(fx[i] - gx[i]),
+                          std::fabs(fy[i] - gy[i]), std::fabs(fz[i] - gz[i])});
+  }
+
+  printf("baseline: %s\n", tNav > 0 ? "al::Nav"
+                                    : "PoseBatch's scalar reference (built "
+                                      "without allolib, al::Nav not timed)");
+  printf("%d agents, faceToward + step, ms per step\n", n);
+  if (tNav > 0)
+  {
+    printf("  %-10s %8.3f\n", perAgent, tNav);
+    printf("  %-10s %8.3f  (%.1fx)\n", "reference", tRef, tNav / tRef);
+    printf("  %-10s %8.3f  (%.1fx)\n", "batch", tBatch, tNav / tBatch);
+  }
+  else
+  {
+    printf("  %-10s %8.3f\n", "reference", tRef);
+    printf("  %-10s %8.3f  (%.1fx)\n", "batch", tBatch, tRef / tBatch);
+  }
+  printf("batch vs reference after %d steps: quaternion %.2e, position %.2e\n",
+         steps, worstQuat, worstPos);
+  printf("turnTowardBatch vs turnToward, one turn: %.2e\n", worstTurn);
+  return 0;
+}
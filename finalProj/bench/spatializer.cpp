@@ -0,0 +1,115 @@
+// Offline benchmark for BatchPanner on a 54 speaker AlloSphere-like layout
+// (rings of 12 at +41 degrees, 30 at 0, 12 at -32.5). No audio device.
+//
+// build: g++ -O3 -march=native -std=c++17 spatializer.cpp -o spatializer
+// usage: ./spatializer [blocks]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../common/BatchPanner.hpp"
+
+const float sampleRate = 44100;
+const int blockSize = 512;
+
+void addRing(int count, float elevationDeg, std::vector<float> &x,
+             std::vector<float> &y, std::vector<float> &z)
+{
+  float el = elevationDeg * (float)M_PI / 180;
+  for (int i = 0; i < count; i++)
+  {
+    float az = 2 * (float)M_PI * i / count;
+    // same convention as al::Speaker::vec(): y up, -z ahead
+    x.push_back(std::sin(az) * std::cos(el));
+    y.push_back(std::sin(el));
+    z.push_back(-std::cos(az) * std::cos(el));
+  }
+}
+
+// seconds per block; `movingFraction` of the sources turn a little every
+// block, the rest sit still and hit the gain cache
+double timeBlock(int sources, float movingFraction, int blocks)
+{
+  std::vector<float> x, y, z;
+  addRing(12, 41, x, y, z);
+  addRing(30, 0, x, y, z);
+  addRing(12, -32.5f, x, y, z);
+
+  BatchPanner panner;
+  panner.setSpeakers(x, y, z);
+  panner.resizeSources(sources);
+  int speakers = panner.speakers();
+
+  std::vector<std::vector<float>> in(sources, std::vector<float>(blockSize));
+  std::vector<std::vector<float>> out(speakers,
+                                      std::vector<float>(blockSize));
+  std::vector<const float *> inPtr;
+  std::vector<float *> outPtr;
+  for (int s = 0; s < sources; s++)
+  {
+    for (int f = 0; f < blockSize; f++)
+    {
+      in[s][f] = std::sin(0.01f * (s + 1) * f);
+    }
+    inPtr.push_back(in[s].data());
+  }
+  for (auto &o : out)
+  {
+    outPtr.push_back(o.data());
+  }
+
+  int moving = (int)(sources * movingFraction);
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < blocks; b++)
+  {
+    for (int s = 0; s < sources; s++)
+    {
+      float az = 0.37f * s + (s < moving ? 0.02f * b : 0);
+      float el = 0.5f * std::sin(0.11f * s);
+      panner.setSource(s, std::sin(az) * std::cos(el), std::sin(el),
+                       -std::cos(az) * std::cos(el));
+    }
+    for (auto &o : out)
+    {
+      std::fill(o.begin(), o.end(), 0.0f);
+    }
+    panner.render(inPtr.data(), outPtr.data(), blockSize);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  float energy = 0;
+  for (auto &o : out)
+  {
+    energy += o[blockSize / 2] * o[blockSize / 2];
+  }
+  if (energy < 0)
+  {
+    printf(" "); // keep the work observable
+  }
+  return seconds / blocks;
+}
+
+int main(int argc, char *argv[])
+{
+  int blocks = argc > 1 ? atoi(argv[1]) : 200;
+  double period = blockSize / sampleRate;
+  printf("54 speakers, %d frame blocks at %.0f Hz: %.2f ms per block\n",
+         blockSize, sampleRate, period * 1e3);
+  printf("%8s %8s %12s %12s\n", "sources", "moving", "ms/block",
+         "% deadline");
+  for (int sources : {16, 64, 256, 1024})
+  {
+    for (float moving : {1.0f, 0.1f})
+    {
+      double t = timeBlock(sources, moving, blocks);
+      printf("%8d %7.0f%% %12.3f %12.1f\n", sources, moving * 100, t * 1e3,
+             100 * t / period);
+    }
+  }
+  return 0;
+}
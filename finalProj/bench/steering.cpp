@@ -0,0 +1,114 @@
+// Times the accumulating steering mode against one turn per rule, and
+// checks that the swarm still looks the same: both runs start from the same
+// scatter, and after `settle` steps the shape of the cloud and how hard the
+// particles turn are compared. "vs each" is the turn per step over that of
+// TURN_EACH with the same kernel, which the ACCUMULATE gain is fitted to.
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread steering.cpp -o steering
+// usage: ./steering [particles] [steps] [settle] [samples]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../PhysarumSim.hpp"
+
+struct Look
+{
+  float radius = 0;   // mean distance from the origin
+  float shell = 0;    // rms distance from the radius 3 shell
+  float turn = 0;     // mean heading change per step, radians, over samples
+  float hueSpread = 0; // rms distance of hue from its circular mean
+};
+
+Look look(PhysarumSim &sim, int samples)
+{
+  int n = sim.size();
+  Look l;
+  std::vector<Float3> before(n);
+  for (int s = 0; s < samples; s++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      before[i] = sim.heading(i);
+    }
+    sim.step();
+    for (int i = 0; i < n; i++)
+    {
+      float c = before[i].dot(sim.heading(i));
+      l.turn += std::acos(std::min(1.0f, std::max(-1.0f, c))) / n;
+    }
+  }
+  l.turn /= samples;
+
+  double cx = 0, cy = 0;
+  for (int i = 0; i < n; i++)
+  {
+    float r = sim.position(i).mag();
+    l.radius += r / n;
+    l.shell += (r - 3) * (r - 3) / n;
+    cx += std::cos(2 * M_PI * sim.particles.hue[i]);
+    cy += std::sin(2 * M_PI * sim.particles.hue[i]);
+  }
+  float mean = std::atan2(cy, cx) / (2 * M_PI);
+  for (int i = 0; i < n; i++)
+  {
+    float d = sim.particles.hue[i] - mean;
+    d -= std::round(d);
+    l.hueSpread += d * d / n;
+  }
+  l.shell = std::sqrt(l.shell);
+  l.hueSpread = std::sqrt(l.hueSpread);
+  return l;
+}
+
+// returns the turn per step
+float run(int n, int kernel, int steerMode, int steps, int settle,
+          int samples, float eachTurn)
+{
+  PhysarumSim sim;
+  sim.rules.kernel = kernel;
+  sim.rules.steerMode = steerMode;
+  sim.threads(1);
+  sim.resize(n);
+  sim.scatter(1);
+  for (int s = 0; s < settle; s++)
+  {
+    sim.step();
+  }
+  Look l = look(sim, samples);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; s++)
+  {
+    sim.step();
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count() /
+              steps;
+  printf("%8d %8s %11s %9.3f %8.3f %8.3f %8.4f %8.2f %8.3f\n", n,
+         kernel == SCALAR ? "scalar" : "batched",
+         steerMode == TURN_EACH ? "turn each" : "accumulate", ms, l.radius,
+         l.shell, l.turn, eachTurn > 0 ? l.turn / eachTurn : 1.0f,
+         l.hueSpread);
+  return l.turn;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 10000;
+  int steps = argc > 2 ? atoi(argv[2]) : 5;
+  int settle = argc > 3 ? atoi(argv[3]) : 100;
+  int samples = argc > 4 ? atoi(argv[4]) : 20;
+  printf("one thread, double buffered, grid neighbors\n");
+  printf("%8s %8s %11s %9s %8s %8s %8s %8s %8s\n", "n", "kernel",
+         "steering", "ms/step", "radius", "shell", "turn", "vs each",
+         "hue rms");
+  for (int kernel : {SCALAR, BATCHED})
+  {
+    float eachTurn = run(n, kernel, TURN_EACH, steps, settle, samples, 0);
+    run(n, kernel, ACCUMULATE, steps, settle, samples, eachTurn);
+  }
+  return 0;
+}
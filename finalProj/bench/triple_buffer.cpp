@@ -0,0 +1,108 @@
+// Stress test for TripleBuffer (common/), the handoff ColorPhysarum uses
+// from the simulation to onSound.
+//
+// A producer thread publishes `publishes` snapshots of 16 words: a
+// sequence number and 15 words made from it. A reader thread stands in
+// for the audio thread: it calls update() in a loop, as onSound does once
+// per block, and checks every snapshot it holds:
+//   torn       some word does not belong to the snapshot's sequence
+//              number, i.e. two publishes got mixed
+//   backwards  the sequence number is below the last one it saw
+// The exit status is 1 if either happened. Both threads yield halfway
+// through a snapshot now and then, so even on one core the other side
+// runs while a write or read is half done. Run it under
+// -fsanitize=thread too.
+//
+// build: g++ -O2 -std=c++17 -pthread triple_buffer.cpp -o triple_buffer
+// usage: ./triple_buffer [publishes]
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "../../common/TripleBuffer.hpp"
+
+struct Snapshot
+{
+  uint64_t sequence;
+  uint64_t words[15];
+};
+
+// a word no other sequence number gives in that place
+uint64_t wordOf(uint64_t sequence, int k)
+{
+  return sequence * 0x9e3779b97f4a7c15ull + (uint64_t)k;
+}
+
+int main(int argc, char *argv[])
+{
+  long publishes = argc > 1 ? atol(argv[1]) : 20000000;
+
+  TripleBuffer<Snapshot> buffer;
+  std::atomic<bool> done{false};
+
+  std::thread producer([&]
+                       {
+                         for (long s = 1; s <= publishes; s++)
+                         {
+                           Snapshot &w = buffer.writeBuffer();
+                           w.sequence = s;
+                           for (int k = 0; k < 15; k++)
+                           {
+                             w.words[k] = wordOf(s, k);
+                             if (k == 7 && s % 64 == 0)
+                             {
+                               std::this_thread::yield(); // mid-write
+                             }
+                           }
+                           buffer.publish();
+                         }
+                         done = true; });
+
+  long updates = 0, reads = 0, torn = 0, backwards = 0;
+  uint64_t last = 0;
+  auto check = [&]
+  {
+    if (updates == 0)
+    {
+      return; // still the zeroed slot: nothing published yet
+    }
+    const Snapshot &r = buffer.read();
+    reads++;
+    for (int k = 0; k < 15; k++)
+    {
+      if (k == 7 && reads % 64 == 0)
+      {
+        std::this_thread::yield(); // mid-read
+      }
+      if (r.words[k] != wordOf(r.sequence, k))
+      {
+        torn++;
+        break;
+      }
+    }
+    if (r.sequence < last)
+    {
+      backwards++;
+    }
+    last = r.sequence;
+  };
+  while (!done)
+  {
+    updates += buffer.update();
+    check();
+  }
+  // the last publish
+  updates += buffer.update();
+  check();
+  producer.join();
+
+  printf("%ld publishes, %ld picked up, %ld reads, last %llu\n", publishes,
+         updates, reads, (unsigned long long)last);
+  printf("torn %ld, backwards %ld\n", torn, backwards);
+  bool ok = torn == 0 && backwards == 0 && (long)last == publishes;
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
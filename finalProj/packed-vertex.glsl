@@ -0,0 +1,51 @@
+#version 400
+
+// Reads particles straight from the state packets (PackedParticle in
+// StateEncoding.hpp): x, y, z and hue as 16 bit unsigned, normalized to
+// [0, 1] by the vertex attribute setup. Each particle has its last three
+// snapshots, one per slot, and is drawn between two of them.
+layout(location = 0) in vec4 slot0;
+layout(location = 1) in vec4 slot1;
+layout(location = 2) in vec4 slot2;
+
+uniform mat4 al_ModelViewMatrix;
+uniform float positionBound;
+// per state chunk: weight of the later snapshot, and the slot it is in;
+// the earlier one is in the slot before (SnapshotHistory::blend)
+uniform int chunkSize;
+uniform vec2 chunkBlend[256];
+
+out Vertex {
+  vec4 color;
+  float size;
+  vec2 uv;
+  vec3 pos;
+}
+vertex;
+
+// hsv(h, 1, 1) to rgb
+vec3 hueToRGB(float h) {
+  vec3 p = abs(fract(h + vec3(1.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0);
+  return clamp(p - 1.0, 0.0, 1.0);
+}
+
+void main() {
+  vec2 blend = chunkBlend[gl_VertexID / chunkSize];
+  vec4 slots[3] = vec4[3](slot0, slot1, slot2);
+  int to = int(blend.y + 0.5);
+  vec4 latest = slots[to];
+  vec4 previous = slots[(to + 2) % 3];
+  vec4 p = mix(previous, latest, blend.x);
+  // hue is a circle: blend the short way round
+  float dh = fract((latest.w - previous.w) * (65535.0 / 65536.0) + 0.5) - 0.5;
+
+  // decodeCoord() and decodeHue()
+  vec3 position = p.xyz * (2.0 * positionBound) - positionBound;
+  float hue = previous.w * (65535.0 / 65536.0) + dh * blend.x;
+
+  gl_Position = al_ModelViewMatrix * vec4(position, 1.0);
+  vertex.color = vec4(hueToRGB(hue), 1.0);
+  vertex.size = 1.0;
+  vertex.uv = vec2(1.0, 0.0);
+  vertex.pos = position;
+}